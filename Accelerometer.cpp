@@ -111,7 +111,7 @@ AccelSensor::AccelSensor(SensorContext *context)
 	memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
 	mPendingEvent.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
 
-	strlcpy(input_sysfs_path, context->enable_path, sizeof(input_sysfs_path));
+	strlcpy(input_sysfs_path, context->info->enable_path, sizeof(input_sysfs_path));
 	input_sysfs_path_len = strlen(input_sysfs_path);
 	data_fd = context->data_fd;
 	ALOGI("The accel sensor path is %s",input_sysfs_path);
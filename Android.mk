@@ -55,6 +55,11 @@ LOCAL_SRC_FILES :=	\
 		Gyroscope.cpp				\
 		Bmp180.cpp				\
 		InputEventReader.cpp \
+		InputDeviceIndex.cpp \
+		StringArena.cpp \
+		EventArena.cpp \
+		FusionPipeline.cpp \
+		InputAligner.cpp \
 		CalibrationManager.cpp \
 		NativeSensorManager.cpp \
 		VirtualSensor.cpp	\
@@ -78,9 +83,13 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := libcalmodule_common
 LOCAL_SRC_FILES := \
 		   algo/common/common_wrapper.c \
+		   algo/common/fast_math.c \
+		   algo/common/fusion_state.c \
 		   algo/common/compass/AKFS_AOC.c \
 		   algo/common/compass/AKFS_Device.c \
 		   algo/common/compass/AKFS_Direction.c \
+		   algo/common/compass/AKFS_Soa.c \
+		   algo/common/compass/AKFS_Sphere.c \
 		   algo/common/compass/AKFS_VNorm.c
 
 LOCAL_SHARED_LIBRARIES := liblog libcutils
@@ -97,6 +106,17 @@ include $(BUILD_SHARED_LIBRARY)
 
 include $(CLEAR_VARS)
 
+LOCAL_MODULE := fast_math_bench
+LOCAL_SRC_FILES := \
+		   algo/common/fast_math.c \
+		   algo/common/fast_math_bench.c
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
 LOCAL_MODULE := calmodule.cfg
 LOCAL_MODULE_TAGS := optional
 LOCAL_MODULE_CLASS := ETC
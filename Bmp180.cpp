@@ -73,7 +73,7 @@ PressureSensor::PressureSensor(struct SensorContext *context)
 	mPendingEvent.type = SENSOR_TYPE_PRESSURE;
 	memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
 	data_fd = context->data_fd;
-	strlcpy(input_sysfs_path, context->enable_path, sizeof(input_sysfs_path));
+	strlcpy(input_sysfs_path, context->info->enable_path, sizeof(input_sysfs_path));
 	input_sysfs_path_len = strlen(input_sysfs_path);
 	mUseAbsTimeStamp = false;
 	enable(0, 1);
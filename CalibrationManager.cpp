@@ -70,6 +70,13 @@ int CalibrationManager::check_algo(const sensor_cal_algo_t *list)
 		return -1;
 	if (list->methods == NULL)
 		return -1;
+	if (list->version >= SENSOR_CAL_ALGO_INSTANCE_VERSION &&
+			list->methods->create != NULL) {
+		if ((list->methods->destroy == NULL) ||
+				(list->methods->instance_convert == NULL))
+			return -1;
+		return 0;
+	}
 	if (list->methods->convert == NULL)
 		return -1;
 	return 0;
@@ -67,6 +67,9 @@ __BEGIN_DECLS
 
 #define SENSOR_CAL_MODULE_VERSION	1
 
+/* Algos of this version and above may provide the instance methods */
+#define SENSOR_CAL_ALGO_INSTANCE_VERSION	2
+
 enum {
 	CMD_ENABLE = 0, /* Enable status changed */
 	CMD_DELAY, /* Polling rate changed */
@@ -98,6 +101,23 @@ struct sensor_algo_methods_t {
 	int (*convert)(sensors_event_t *raw, sensors_event_t *result, struct sensor_algo_args *args);
 	/* Note that the config callback is called from a different thread as convert */
 	int (*config)(int cmd, struct sensor_algo_args *args);
+
+	/* The following are only read if the algo version is at least
+	 * SENSOR_CAL_ALGO_INSTANCE_VERSION. Each sensor driver using the algo
+	 * creates its own instance, and the instance_* callbacks only touch the
+	 * state of the instance they are given. Like config, instance_config is
+	 * called from a different thread as instance_convert on the same
+	 * instance. Algos without state leave create NULL and keep using convert
+	 * and config.
+	 */
+	/* inputs are the handles of the sensors the instance is fed, in
+	 * ascending order. Return the new instance, or NULL on failure.
+	 */
+	void* (*create)(const struct sensor_t *sensor, const int *inputs, int count);
+	void (*destroy)(void *instance);
+	int (*instance_convert)(void *instance, sensors_event_t *raw, sensors_event_t *result,
+			struct sensor_algo_args *args);
+	int (*instance_config)(void *instance, int cmd, struct sensor_algo_args *args);
 };
 
 struct sensor_cal_methods_t {
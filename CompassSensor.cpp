@@ -73,7 +73,7 @@ CompassSensor::CompassSensor(struct SensorContext *context)
 	mPendingEvent.magnetic.status = SENSOR_STATUS_UNRELIABLE;
 
 	data_fd = context->data_fd;
-	strlcpy(input_sysfs_path, context->enable_path, sizeof(input_sysfs_path));
+	strlcpy(input_sysfs_path, context->info->enable_path, sizeof(input_sysfs_path));
 	input_sysfs_path_len = strlen(input_sysfs_path);
 
 	enable(0, 1);
@@ -102,8 +102,8 @@ int CompassSensor::enable(int32_t, int en) {
 	if (flags != mEnabled) {
 		int fd;
 
-		if ((algo != NULL) && (algo->methods->config != NULL)) {
-			if (algo->methods->config(CMD_ENABLE, (sensor_algo_args*)&arg)) {
+		if (algo != NULL) {
+			if (algoConfig(CMD_ENABLE, (sensor_algo_args*)&arg)) {
 				ALOGW("Calling enable config failed for compass");
 			}
 		}
@@ -149,8 +149,8 @@ int CompassSensor::setDelay(int32_t, int64_t delay_ns)
 		return 0;
 	}
 
-	if ((algo != NULL) && (algo->methods->config != NULL)) {
-		if (algo->methods->config(CMD_DELAY, (sensor_algo_args*)&arg)) {
+	if (algo != NULL) {
+		if (algoConfig(CMD_DELAY, (sensor_algo_args*)&arg)) {
 			ALOGW("Calling delay config failed for compass");
 		}
 	}
@@ -227,7 +227,7 @@ again:
 						raw = mPendingEvent;
 
 						if (algo != NULL) {
-							if (algo->methods->convert(&raw, &result, NULL)) {
+							if (algoConvert(&raw, &result, NULL)) {
 								ALOGE("Calibration failed.");
 								result.magnetic.x = CALIBRATE_ERROR_MAGIC;
 								result.magnetic.y = CALIBRATE_ERROR_MAGIC;
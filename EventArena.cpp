@@ -0,0 +1,126 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "EventArena.h"
+
+ANDROID_SINGLETON_STATIC_INSTANCE(EventArena);
+
+EventArena::EventArena()
+	: mFree(NULL), mTotal(0), mInUse(0), mMax(0)
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	property_get(EVENT_ARENA_PROPERTY, value, EVENT_ARENA_DEFAULT);
+	mMax = atoi(value);
+	if (mMax < 1)
+		mMax = atoi(EVENT_ARENA_DEFAULT);
+}
+
+EventArena::~EventArena()
+{
+	struct EventChunk *chunk;
+
+	while (mFree != NULL) {
+		chunk = mFree;
+		mFree = chunk->next;
+		free(chunk);
+	}
+}
+
+int EventArena::alloc(struct EventChunk **chunks, int count)
+{
+	struct EventChunk *chunk;
+	int i;
+	Mutex::Autolock _l(mLock);
+
+	for (i = 0; i < count; i++) {
+		if (mFree != NULL) {
+			chunk = mFree;
+			mFree = chunk->next;
+		} else {
+			/* Over the cap only to give a ring its first chunk */
+			if ((mTotal >= mMax) && (i > 0))
+				break;
+			chunk = (struct EventChunk*)malloc(sizeof(*chunk));
+			if (chunk == NULL)
+				break;
+			mTotal++;
+		}
+
+		chunks[i] = chunk;
+		mInUse++;
+	}
+
+	ALOGW_IF(i < count, "event arena: %d of %d chunks given, %d/%d in use\n",
+			i, count, mInUse, mMax);
+
+	return i;
+}
+
+/* Keep the chunks for the next ring, but give the memory back to the system
+ * for what is above the cap.
+ */
+void EventArena::release(struct EventChunk **chunks, int count)
+{
+	int i;
+	Mutex::Autolock _l(mLock);
+
+	for (i = 0; i < count; i++) {
+		if (chunks[i] == NULL)
+			continue;
+		mInUse--;
+		if (mTotal > mMax) {
+			free(chunks[i]);
+			mTotal--;
+		} else {
+			chunks[i]->next = mFree;
+			mFree = chunks[i];
+		}
+		chunks[i] = NULL;
+	}
+}
+
+int EventArena::getInUse()
+{
+	Mutex::Autolock _l(mLock);
+
+	return mInUse;
+}
+
+int EventArena::getTotal()
+{
+	Mutex::Autolock _l(mLock);
+
+	return mTotal;
+}
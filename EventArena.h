@@ -0,0 +1,77 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_EVENT_ARENA_H
+#define SENSOR_EVENT_ARENA_H
+
+#include <stdint.h>
+#include <hardware/sensors.h>
+#include <utils/Singleton.h>
+#include <utils/Mutex.h>
+
+using namespace android;
+
+#define EVENT_CHUNK_SHIFT	5
+#define EVENT_CHUNK_EVENTS	(1 << EVENT_CHUNK_SHIFT)
+/* Global cap on the chunks of all the event rings */
+#define EVENT_ARENA_PROPERTY	"sensors.arena.chunks"
+#define EVENT_ARENA_DEFAULT	"64"
+
+struct EventChunk {
+	union {
+		struct EventChunk *next; // while on the free list
+		sensors_event_t events[EVENT_CHUNK_EVENTS];
+	};
+};
+
+/* Pool of event chunks shared by the virtual sensor rings. Chunks are only
+ * allocated when a ring needs them and go back to the free list when the
+ * ring is destroyed, so the memory follows the enabled sensors. The total
+ * is capped, a ring only gets what is left under the cap but never less
+ * than one chunk.
+ */
+class EventArena : public Singleton<EventArena> {
+	friend class Singleton<EventArena>;
+	EventArena();
+	~EventArena();
+
+	Mutex mLock;
+	struct EventChunk *mFree;
+	int mTotal; // chunks allocated, free or in use
+	int mInUse;
+	int mMax;
+public:
+	/* Fill chunks with up to count chunks. Return the number given. */
+	int alloc(struct EventChunk **chunks, int count);
+	void release(struct EventChunk **chunks, int count);
+	int getInUse();
+	int getTotal();
+};
+
+#endif
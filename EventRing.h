@@ -0,0 +1,242 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_EVENT_RING_H
+#define SENSOR_EVENT_RING_H
+
+#include <stdint.h>
+#include <hardware/sensors.h>
+#include <utils/Atomic.h>
+
+#include "EventArena.h"
+
+enum {
+	EVENT_RING_DROP_NEWEST = 0, // keep the queued events, drop the new one
+	EVENT_RING_OVERWRITE, // drop the oldest event to make room
+	EVENT_RING_COALESCE, // only keep the latest event
+};
+
+#define EVENT_RING_DIRTY	0x4
+#define EVENT_RING_INDEX	0x3
+
+/* Ring of sensor events with one producer and one consumer, which may run on
+ * different threads without a lock. Each side only moves its own index and
+ * publishes it with a release store. The indexes run freely and are masked,
+ * so the size is rounded up to a power of two. The slots live in chunks of
+ * the EventArena and the ring shrinks to what the arena can give.
+ *
+ * With EVENT_RING_OVERWRITE the producer moves the tail as well when the ring
+ * is full, so both sides claim the tail with a compare and swap and the
+ * consumer retries if its copy got overwritten.
+ *
+ * EVENT_RING_COALESCE is a triple buffer: the producer fills the back slot
+ * and swaps it with the middle one, the consumer swaps the middle slot with
+ * the front one when it is newer. Its three slots are its own rather than a
+ * whole chunk of the arena.
+ */
+class EventRing {
+	struct EventChunk **mChunks;
+	int mChunkCount;
+	uint32_t mMask;
+	int mPolicy;
+	volatile int32_t mHead; // next slot to write, moved by the producer
+	volatile int32_t mTail; // next slot to read
+	volatile int32_t mMiddle; // coalesce: middle slot and EVENT_RING_DIRTY
+	int mBack; // coalesce: slot owned by the producer
+	int mFront; // coalesce: slot owned by the consumer
+	sensors_event_t *mTriple; // coalesce: the three slots
+	volatile int32_t mDropped;
+
+	EventRing(const EventRing&);
+	EventRing& operator=(const EventRing&);
+
+	sensors_event_t* slot(uint32_t i) const {
+		i &= mMask;
+		return &mChunks[i >> EVENT_CHUNK_SHIFT]->events[i & (EVENT_CHUNK_EVENTS - 1)];
+	}
+
+	int32_t swapMiddle(int32_t slot) {
+		int32_t old;
+
+		do {
+			old = mMiddle;
+		} while (android_atomic_cmpxchg(old, slot, &mMiddle));
+
+		return old;
+	}
+public:
+	EventRing(int size, int policy)
+		: mChunks(NULL), mChunkCount(0), mMask(0), mPolicy(policy), mHead(0),
+		  mTail(0), mMiddle(1), mBack(0), mFront(2), mTriple(NULL), mDropped(0)
+	{
+		EventArena& arena(EventArena::getInstance());
+		uint32_t n = EVENT_CHUNK_EVENTS;
+		int given;
+
+		if (policy == EVENT_RING_COALESCE) {
+			mTriple = new sensors_event_t[3];
+			return;
+		}
+
+		while ((int)n < size)
+			n <<= 1;
+
+		mChunkCount = n >> EVENT_CHUNK_SHIFT;
+		mChunks = new struct EventChunk*[mChunkCount];
+		given = arena.alloc(mChunks, mChunkCount);
+
+		/* Keep a power of two of what was given */
+		while (mChunkCount > given)
+			mChunkCount >>= 1;
+		arena.release(mChunks + mChunkCount, given - mChunkCount);
+
+		mMask = (mChunkCount << EVENT_CHUNK_SHIFT) - 1;
+	}
+
+	~EventRing() {
+		EventArena::getInstance().release(mChunks, mChunkCount);
+		delete [] mChunks;
+		delete [] mTriple;
+	}
+
+	int getSize() const {
+		if (mPolicy == EVENT_RING_COALESCE)
+			return 1;
+
+		return (mChunkCount == 0) ? 0 : mMask + 1;
+	}
+
+	int getPolicy() const {
+		return mPolicy;
+	}
+
+	/* Events dropped or overwritten so far */
+	uint32_t getDropped() const {
+		return android_atomic_acquire_load(&mDropped);
+	}
+
+	int getCount() const {
+		if (mPolicy == EVENT_RING_COALESCE)
+			return (android_atomic_acquire_load(&mMiddle) & EVENT_RING_DIRTY) ? 1 : 0;
+
+		return (uint32_t)android_atomic_acquire_load(&mHead) -
+			(uint32_t)android_atomic_acquire_load(&mTail);
+	}
+
+	bool isEmpty() const {
+		return getCount() == 0;
+	}
+
+	/* Producer: the next free slot, or NULL if the event has to be dropped */
+	sensors_event_t* reserve() {
+		uint32_t head = mHead;
+		uint32_t tail;
+
+		if (mPolicy == EVENT_RING_COALESCE)
+			return &mTriple[mBack];
+
+		/* The arena had nothing left */
+		if (mChunkCount == 0) {
+			android_atomic_inc(&mDropped);
+			return NULL;
+		}
+
+		for (;;) {
+			tail = android_atomic_acquire_load(&mTail);
+			if (head - tail <= mMask)
+				break;
+
+			if (mPolicy == EVENT_RING_DROP_NEWEST) {
+				android_atomic_inc(&mDropped);
+				return NULL;
+			}
+
+			/* Take the oldest slot away from the consumer */
+			if (android_atomic_cmpxchg(tail, tail + 1, &mTail) == 0) {
+				android_atomic_inc(&mDropped);
+				break;
+			}
+		}
+
+		return slot(head);
+	}
+
+	/* Producer: publish the slot returned by reserve() */
+	void commit() {
+		int32_t old;
+
+		if (mPolicy == EVENT_RING_COALESCE) {
+			old = swapMiddle(mBack | EVENT_RING_DIRTY);
+			if (old & EVENT_RING_DIRTY)
+				android_atomic_inc(&mDropped);
+			mBack = old & EVENT_RING_INDEX;
+			return;
+		}
+
+		android_atomic_release_store(mHead + 1, &mHead);
+	}
+
+	/* Consumer: copy out up to count events */
+	int read(sensors_event_t *data, int count) {
+		uint32_t tail;
+		uint32_t avail;
+		int i;
+		int n;
+
+		if (mPolicy == EVENT_RING_COALESCE) {
+			if ((count < 1) || !(android_atomic_acquire_load(&mMiddle) & EVENT_RING_DIRTY))
+				return 0;
+			mFront = swapMiddle(mFront) & EVENT_RING_INDEX;
+			data[0] = mTriple[mFront];
+			return 1;
+		}
+
+		for (;;) {
+			tail = android_atomic_acquire_load(&mTail);
+			avail = (uint32_t)android_atomic_acquire_load(&mHead) - tail;
+			n = ((uint32_t)count > avail) ? avail : count;
+
+			for (i = 0; i < n; i++)
+				data[i] = *slot(tail + i);
+
+			if (mPolicy != EVENT_RING_OVERWRITE) {
+				android_atomic_release_store(tail + n, &mTail);
+				break;
+			}
+
+			/* Retry if the producer overwrote what was copied */
+			if (android_atomic_cmpxchg(tail, tail + n, &mTail) == 0)
+				break;
+		}
+
+		return n;
+	}
+};
+
+#endif
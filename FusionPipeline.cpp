@@ -0,0 +1,235 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <utils/Atomic.h>
+
+#include "FusionPipeline.h"
+#include "VirtualSensor.h"
+
+ANDROID_SINGLETON_STATIC_INSTANCE(FusionPipeline);
+
+FusionPipeline::FusionPipeline()
+	: mQueue(NULL), mDepth(0), mHead(0), mCount(0),
+	  mPolicy(FUSION_DROP_NEWEST), mBusy(NULL), mExit(false),
+	  mRunning(false), mNotified(0), mDropped(0)
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	mNotifyFds[0] = mNotifyFds[1] = -1;
+
+	property_get(FUSION_DEPTH_PROPERTY, value, FUSION_DEPTH_DEFAULT);
+	mDepth = atoi(value);
+	if (mDepth <= 0) {
+		ALOGI("Virtual sensor algos run on the poll thread\n");
+		return;
+	}
+
+	property_get(FUSION_DROP_PROPERTY, value, FUSION_DROP_DEFAULT);
+	if (strcmp(value, "oldest") == 0)
+		mPolicy = FUSION_DROP_OLDEST;
+
+	if (pipe(mNotifyFds)) {
+		ALOGE("error creating fusion notify pipe (%s)", strerror(errno));
+		mNotifyFds[0] = mNotifyFds[1] = -1;
+		return;
+	}
+	fcntl(mNotifyFds[0], F_SETFL, O_NONBLOCK);
+	fcntl(mNotifyFds[1], F_SETFL, O_NONBLOCK);
+
+	mQueue = new struct FusionJob[mDepth];
+
+	if (pthread_create(&mThread, NULL, workerThread, this)) {
+		ALOGE("error creating fusion worker, run on the poll thread\n");
+		delete [] mQueue;
+		mQueue = NULL;
+		close(mNotifyFds[0]);
+		close(mNotifyFds[1]);
+		mNotifyFds[0] = mNotifyFds[1] = -1;
+		return;
+	}
+
+	mRunning = true;
+	ALOGI("Fusion worker started, depth:%d drop:%s\n", mDepth,
+			mPolicy == FUSION_DROP_OLDEST ? "oldest" : "newest");
+}
+
+FusionPipeline::~FusionPipeline()
+{
+	if (mRunning) {
+		mLock.lock();
+		mExit = true;
+		mWork.signal();
+		mLock.unlock();
+		pthread_join(mThread, NULL);
+	}
+
+	if (mNotifyFds[0] >= 0) {
+		close(mNotifyFds[0]);
+		close(mNotifyFds[1]);
+	}
+
+	delete [] mQueue;
+}
+
+void* FusionPipeline::workerThread(void *arg)
+{
+	((FusionPipeline*)arg)->run();
+	return NULL;
+}
+
+/* Called with mLock held. Dequeue the leading events of one target. */
+int FusionPipeline::takeSpan(VirtualSensor **target, sensors_event_t *data)
+{
+	int n = 0;
+
+	*target = mQueue[mHead].target;
+	while (mCount && (n < FUSION_SPAN_EVENTS) && (mQueue[mHead].target == *target)) {
+		data[n++] = mQueue[mHead].event;
+		mHead = (mHead + 1) % mDepth;
+		mCount--;
+	}
+
+	return n;
+}
+
+void FusionPipeline::run()
+{
+	sensors_event_t span[FUSION_SPAN_EVENTS];
+	VirtualSensor *target;
+	int n;
+
+	mLock.lock();
+	while (!mExit) {
+		if (mCount == 0) {
+			mWork.wait(mLock);
+			continue;
+		}
+
+		n = takeSpan(&target, span);
+		mBusy = target;
+		mLock.unlock();
+
+		if (target->process(span, n) > 0)
+			notify();
+
+		mLock.lock();
+		mBusy = NULL;
+		mIdle.broadcast();
+	}
+	mLock.unlock();
+}
+
+/* Only the first result after a clearNotify() writes to the pipe */
+void FusionPipeline::notify()
+{
+	const char msg = 'F';
+	int result;
+
+	if (android_atomic_inc(&mNotified) == 0) {
+		result = write(mNotifyFds[1], &msg, 1);
+		ALOGE_IF(result < 0, "error sending fusion notify (%s)", strerror(errno));
+	}
+}
+
+void FusionPipeline::clearNotify()
+{
+	char buf[16];
+
+	while (read(mNotifyFds[0], buf, sizeof(buf)) > 0)
+		;
+
+	/* Results published before this point are already in the rings */
+	android_atomic_release_store(0, &mNotified);
+}
+
+int FusionPipeline::submit(VirtualSensor *target, const sensors_event_t *data, int count)
+{
+	int i;
+	int slot;
+	int dropped = 0;
+	Mutex::Autolock _l(mLock);
+
+	for (i = 0; i < count; i++) {
+		if (mCount == mDepth) {
+			if (mPolicy == FUSION_DROP_NEWEST) {
+				dropped += count - i;
+				break;
+			}
+			mHead = (mHead + 1) % mDepth;
+			mCount--;
+			dropped++;
+		}
+
+		slot = (mHead + mCount) % mDepth;
+		mQueue[slot].target = target;
+		mQueue[slot].event = data[i];
+		mCount++;
+	}
+
+	mDropped += dropped;
+	if (count)
+		mWork.signal();
+
+	return dropped;
+}
+
+void FusionPipeline::purge(VirtualSensor *target)
+{
+	int i;
+	int n = 0;
+	int src;
+	int dst;
+	Mutex::Autolock _l(mLock);
+
+	if (!mRunning)
+		return;
+
+	/* Compact the queue in place, keeping the order of the others */
+	for (i = 0; i < mCount; i++) {
+		src = (mHead + i) % mDepth;
+		if (mQueue[src].target == target)
+			continue;
+		dst = (mHead + n) % mDepth;
+		if (dst != src)
+			mQueue[dst] = mQueue[src];
+		n++;
+	}
+	mCount = n;
+
+	while (mBusy == target)
+		mIdle.wait(mLock);
+}
@@ -0,0 +1,107 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_FUSION_PIPELINE_H
+#define SENSOR_FUSION_PIPELINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <hardware/sensors.h>
+#include <utils/Singleton.h>
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
+
+using namespace android;
+
+/* Number of queued input events, 0 runs the algos on the poll thread */
+#define FUSION_DEPTH_PROPERTY	"sensors.fusion.depth"
+#define FUSION_DEPTH_DEFAULT	"256"
+/* "newest" rejects the incoming events when the queue is full,
+ * "oldest" discards the events queued first to make room.
+ */
+#define FUSION_DROP_PROPERTY	"sensors.fusion.drop"
+#define FUSION_DROP_DEFAULT	"newest"
+/* Events of one virtual sensor converted per lock round trip */
+#define FUSION_SPAN_EVENTS	32
+
+class VirtualSensor;
+
+enum {
+	FUSION_DROP_NEWEST = 0,
+	FUSION_DROP_OLDEST,
+};
+
+struct FusionJob {
+	VirtualSensor *target;
+	sensors_event_t event;
+};
+
+/* Runs the virtual sensor algos on a worker thread so that the poll thread
+ * only copies the input events. The results go to the EventRing of each
+ * virtual sensor and the notify fd becomes readable.
+ */
+class FusionPipeline : public Singleton<FusionPipeline> {
+	friend class Singleton<FusionPipeline>;
+	FusionPipeline();
+	~FusionPipeline();
+
+	Mutex mLock;
+	Condition mWork; // jobs queued or exit requested
+	Condition mIdle; // the worker finished a span
+	struct FusionJob *mQueue;
+	int mDepth;
+	int mHead;
+	int mCount;
+	int mPolicy;
+	VirtualSensor *mBusy; // target of the span being converted
+	bool mExit;
+	bool mRunning;
+	pthread_t mThread;
+	int mNotifyFds[2];
+	volatile int32_t mNotified;
+	uint32_t mDropped;
+
+	static void* workerThread(void *arg);
+	void run();
+	int takeSpan(VirtualSensor **target, sensors_event_t *data);
+	void notify();
+public:
+	/* False if the algos run synchronously */
+	bool isAsync() const { return mRunning; };
+	/* Queue events for target. Return the number of dropped events. */
+	int submit(VirtualSensor *target, const sensors_event_t *data, int count);
+	/* Drop the queued events of target and wait until the worker leaves it */
+	void purge(VirtualSensor *target);
+	/* Readable when converted events are available */
+	int getNotifyFd() const { return mNotifyFds[0]; };
+	void clearNotify();
+	uint32_t getDropped() const { return mDropped; };
+};
+
+#endif
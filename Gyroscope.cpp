@@ -83,7 +83,7 @@ GyroSensor::GyroSensor(struct SensorContext *context)
 	mPendingEvent.gyro.status = SENSOR_STATUS_ACCURACY_HIGH;
 
 	data_fd = context->data_fd;
-	strlcpy(input_sysfs_path, context->enable_path, sizeof(input_sysfs_path));
+	strlcpy(input_sysfs_path, context->info->enable_path, sizeof(input_sysfs_path));
 	input_sysfs_path_len = strlen(input_sysfs_path);
 	mUseAbsTimeStamp = false;
 	mSensor = *(context->sensor);
@@ -267,7 +267,7 @@ again:
 					if(mPendingEvent.timestamp >= mEnabledTime) {
 						raw = mPendingEvent;
 						if (algo != NULL) {
-							if (algo->methods->convert(&raw, &result, NULL)) {
+							if (algoConvert(&raw, &result, NULL)) {
 								ALOGE("Calibrated failed\n");
 								result = raw;
 							}
@@ -339,7 +339,7 @@ int GyroSensor::read_dynamic_calibrate_params(struct sensor_t *sensor)
 	arg.common.sensor = *sensor;
 
 	if (algo != NULL) {
-		if (algo->methods->config(CMD_INIT, (sensor_algo_args*)&arg)) {
+		if (algoConfig(CMD_INIT, (sensor_algo_args*)&arg)) {
 			ALOGE("Init gyro calibration parameters failed\n");
 			return -1;
 		}
@@ -0,0 +1,227 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "InputAligner.h"
+
+/* Number of floats to interpolate, the rest is copied from the nearest sample */
+static int interp_size(int type)
+{
+	switch (type) {
+		case SENSOR_TYPE_ACCELEROMETER:
+		case SENSOR_TYPE_MAGNETIC_FIELD:
+		case SENSOR_TYPE_GYROSCOPE:
+		case SENSOR_TYPE_GRAVITY:
+		case SENSOR_TYPE_LINEAR_ACCELERATION:
+			return 3;
+		case SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED:
+		case SENSOR_TYPE_GYROSCOPE_UNCALIBRATED:
+			return 6;
+		default:
+			return 1;
+	}
+}
+
+int64_t InputAligner::getLatency()
+{
+	char value[PROPERTY_VALUE_MAX];
+	int ms;
+
+	property_get(ALIGN_LATENCY_PROPERTY, value, ALIGN_LATENCY_DEFAULT);
+	ms = atoi(value);
+
+	return (ms > 0) ? ms * 1000000LL : 0;
+}
+
+InputAligner::InputAligner(const int *types, int count, int64_t latency_ns)
+	: mCount(0), mLatency(latency_ns)
+{
+	int i;
+
+	if (count > ALIGN_MAX_INPUTS)
+		count = ALIGN_MAX_INPUTS;
+
+	memset(mStreams, 0, sizeof(mStreams));
+	for (i = 0; i < count; i++)
+		mStreams[i].type = types[i];
+	mCount = count;
+}
+
+struct AlignStream* InputAligner::getStream(int type)
+{
+	int i;
+
+	for (i = 0; i < mCount; i++) {
+		if (mStreams[i].type == type)
+			return &mStreams[i];
+	}
+
+	return NULL;
+}
+
+/* Average sample interval over the history */
+int64_t InputAligner::getInterval(const struct AlignStream *s)
+{
+	uint32_t n = (s->head < ALIGN_HISTORY) ? s->head : ALIGN_HISTORY;
+	const sensors_event_t *newest;
+	const sensors_event_t *oldest;
+
+	if (n < 2)
+		return 0;
+
+	newest = &s->hist[(s->head - 1) & (ALIGN_HISTORY - 1)];
+	oldest = &s->hist[(s->head - n) & (ALIGN_HISTORY - 1)];
+
+	return (newest->timestamp - oldest->timestamp) / (n - 1);
+}
+
+/* Sample s at time t from the two samples around it, or hold the nearest */
+void InputAligner::interpolate(const struct AlignStream *s, int64_t t, sensors_event_t *out)
+{
+	uint32_t n = (s->head < ALIGN_HISTORY) ? s->head : ALIGN_HISTORY;
+	uint32_t i;
+	const sensors_event_t *a = NULL;
+	const sensors_event_t *b = NULL;
+	const sensors_event_t *e;
+	float k;
+	int j;
+	int size;
+
+	for (i = s->head - n; i != s->head; i++) {
+		e = &s->hist[i & (ALIGN_HISTORY - 1)];
+		if (e->timestamp <= t) {
+			a = e;
+		} else {
+			b = e;
+			break;
+		}
+	}
+
+	if ((a == NULL) || (b == NULL)) {
+		*out = (a != NULL) ? *a : *b;
+		out->timestamp = t;
+		return;
+	}
+
+	*out = *a;
+	out->timestamp = t;
+	k = (float)(t - a->timestamp) / (float)(b->timestamp - a->timestamp);
+
+	size = interp_size(s->type);
+	for (j = 0; j < size; j++)
+		out->data[j] = a->data[j] + k * (b->data[j] - a->data[j]);
+}
+
+int InputAligner::push(const sensors_event_t *event, const sensors_event_t **out)
+{
+	struct AlignStream *s = getStream(event->type);
+	struct AlignStream *next;
+	struct AlignStream *trigger;
+	const sensors_event_t *e;
+	int64_t watermark;
+	int64_t newest;
+	int64_t interval;
+	int64_t longest;
+	int number = 0;
+	int i;
+
+	*out = mOut;
+
+	/* Not an input, pass it through */
+	if (s == NULL) {
+		mOut[0] = *event;
+		return 1;
+	}
+
+	/* Only when the latency bound outlasts the history: lose the oldest */
+	if (s->head - s->released >= ALIGN_HISTORY - 1)
+		s->released++;
+
+	s->hist[s->head & (ALIGN_HISTORY - 1)] = *event;
+	s->head++;
+
+	/* Every input has reached the watermark */
+	watermark = LLONG_MAX;
+	newest = LLONG_MIN;
+	longest = -1;
+	trigger = NULL;
+	for (i = 0; i < mCount; i++) {
+		if (mStreams[i].head == 0) {
+			watermark = LLONG_MIN;
+			continue;
+		}
+		e = &mStreams[i].hist[(mStreams[i].head - 1) & (ALIGN_HISTORY - 1)];
+		if (e->timestamp < watermark)
+			watermark = e->timestamp;
+		if (e->timestamp > newest)
+			newest = e->timestamp;
+		interval = getInterval(&mStreams[i]);
+		if (interval > longest) {
+			longest = interval;
+			trigger = &mStreams[i];
+		}
+	}
+
+	while (number + mCount <= ALIGN_OUT_EVENTS) {
+		/* The oldest pending sample */
+		next = NULL;
+		for (i = 0; i < mCount; i++) {
+			if (mStreams[i].released == mStreams[i].head)
+				continue;
+			e = &mStreams[i].hist[mStreams[i].released & (ALIGN_HISTORY - 1)];
+			if ((next == NULL) || (e->timestamp <
+					next->hist[next->released & (ALIGN_HISTORY - 1)].timestamp))
+				next = &mStreams[i];
+		}
+		if (next == NULL)
+			break;
+
+		e = &next->hist[next->released & (ALIGN_HISTORY - 1)];
+		if ((e->timestamp > watermark) && (newest - e->timestamp < mLatency))
+			break;
+
+		if (next == trigger) {
+			for (i = 0; i < mCount; i++) {
+				if ((&mStreams[i] != next) && mStreams[i].head)
+					interpolate(&mStreams[i], e->timestamp, &mOut[number++]);
+			}
+		}
+
+		mOut[number++] = *e;
+		next->released++;
+	}
+
+	return number;
+}
@@ -0,0 +1,74 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_INPUT_ALIGNER_H
+#define SENSOR_INPUT_ALIGNER_H
+
+#include <stdint.h>
+#include <hardware/sensors.h>
+
+/* How long in ms a sample may wait for the other inputs, 0 disables */
+#define ALIGN_LATENCY_PROPERTY	"sensors.align.latency_ms"
+#define ALIGN_LATENCY_DEFAULT	"20"
+#define ALIGN_MAX_INPUTS	4
+/* Samples kept per input, a power of two */
+#define ALIGN_HISTORY		16
+#define ALIGN_OUT_EVENTS	(ALIGN_MAX_INPUTS * ALIGN_HISTORY)
+
+struct AlignStream {
+	int type;
+	sensors_event_t hist[ALIGN_HISTORY];
+	uint32_t head; // samples pushed
+	uint32_t released; // samples handed to the algo
+};
+
+/* Time alignment of the inputs of a virtual sensor. Samples are held until
+ * every input has caught up with them and released in timestamp order. The
+ * slowest input drives the outputs of the fusion algos, so each of its
+ * samples is preceded by the other inputs interpolated at its timestamp.
+ * A sample is released anyway once it is older than the latency bound.
+ */
+class InputAligner {
+	struct AlignStream mStreams[ALIGN_MAX_INPUTS];
+	int mCount;
+	int64_t mLatency;
+	sensors_event_t mOut[ALIGN_OUT_EVENTS];
+
+	struct AlignStream* getStream(int type);
+	int64_t getInterval(const struct AlignStream *s);
+	void interpolate(const struct AlignStream *s, int64_t t, sensors_event_t *out);
+public:
+	InputAligner(const int *types, int count, int64_t latency_ns);
+	/* Queue a sample and return the events released, *out points to them */
+	int push(const sensors_event_t *event, const sensors_event_t **out);
+	/* The latency bound from the property, 0 if alignment is disabled */
+	static int64_t getLatency();
+};
+
+#endif
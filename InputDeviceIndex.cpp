@@ -0,0 +1,221 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <linux/input.h>
+#include <utils/Log.h>
+#include <hardware/hardware.h>
+
+#include "InputDeviceIndex.h"
+
+ANDROID_SINGLETON_STATIC_INSTANCE(InputDeviceIndex);
+
+static uint32_t hash_string(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+
+	return h & (INPUT_HASH_SIZE - 1);
+}
+
+InputDeviceIndex::InputDeviceIndex()
+	: mValid(false), mCount(0)
+{
+}
+
+InputDeviceIndex::~InputDeviceIndex()
+{
+}
+
+void InputDeviceIndex::build()
+{
+	struct dirent **namelist;
+	struct InputDevice *dev;
+	char sysfs[PATH_MAX];
+	uint32_t h;
+	int nNodes;
+	int fd;
+	int i;
+
+	memset(mNameHash, -1, sizeof(mNameHash));
+	memset(mParentHash, -1, sizeof(mParentHash));
+	mCount = 0;
+	mValid = true;
+
+	nNodes = scandir(INPUT_DEVICE_PATH, &namelist, 0, alphasort);
+	if (nNodes < 0) {
+		ALOGE("scan %s failed.(%s)\n", INPUT_DEVICE_PATH, strerror(errno));
+		return;
+	}
+
+	for (i = 0; i < nNodes; i++) {
+		if ((mCount >= MAX_INPUT_DEVICES) ||
+				strncmp(namelist[i]->d_name, "event", strlen("event")))
+			goto next;
+
+		dev = &mDevices[mCount];
+		strlcpy(dev->path, INPUT_DEVICE_PATH, sizeof(dev->path));
+		strlcat(dev->path, namelist[i]->d_name, sizeof(dev->path));
+
+		fd = open(dev->path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			ALOGE("open %s failed(%s)", dev->path, strerror(errno));
+			goto next;
+		}
+
+		if (ioctl(fd, EVIOCGNAME(sizeof(dev->name) - 1), dev->name) < 1)
+			dev->name[0] = '\0';
+		close(fd);
+
+		/* /sys/class/input/eventX/device is the inputX the node belongs to */
+		strlcpy(sysfs, INPUT_CLASS_PATH, sizeof(sysfs));
+		strlcat(sysfs, namelist[i]->d_name, sizeof(sysfs));
+		strlcat(sysfs, "/device", sizeof(sysfs));
+		if (realpath(sysfs, dev->parent) == NULL)
+			dev->parent[0] = '\0';
+
+		/* Keep the first node for duplicated names, as a linear scan would */
+		if (lookupName(dev->name) == NULL) {
+			h = hash_string(dev->name);
+			dev->next_name = mNameHash[h];
+			mNameHash[h] = mCount;
+		} else {
+			dev->next_name = -1;
+		}
+
+		if (dev->parent[0] != '\0') {
+			h = hash_string(dev->parent);
+			dev->next_parent = mParentHash[h];
+			mParentHash[h] = mCount;
+		} else {
+			dev->next_parent = -1;
+		}
+
+		mCount++;
+next:
+		free(namelist[i]);
+	}
+
+	free(namelist);
+
+	ALOGI("%d input devices indexed\n", mCount);
+}
+
+const struct InputDevice* InputDeviceIndex::lookupName(const char *name)
+{
+	int i;
+
+	for (i = mNameHash[hash_string(name)]; i >= 0; i = mDevices[i].next_name) {
+		if (strcmp(mDevices[i].name, name) == 0)
+			return &mDevices[i];
+	}
+
+	return NULL;
+}
+
+const struct InputDevice* InputDeviceIndex::lookupParent(const char *parent)
+{
+	int i;
+
+	for (i = mParentHash[hash_string(parent)]; i >= 0; i = mDevices[i].next_parent) {
+		if (strcmp(mDevices[i].parent, parent) == 0)
+			return &mDevices[i];
+	}
+
+	return NULL;
+}
+
+int InputDeviceIndex::findByName(const char *name, char *path, size_t len)
+{
+	const struct InputDevice *dev;
+	Mutex::Autolock _l(mLock);
+
+	if (name == NULL)
+		return -EINVAL;
+
+	if (!mValid)
+		build();
+
+	dev = lookupName(name);
+	if (dev == NULL)
+		return -ENOENT;
+
+	strlcpy(path, dev->path, len);
+
+	return 0;
+}
+
+int InputDeviceIndex::findByParent(const char *sysfs_path, char *path, size_t len)
+{
+	const struct InputDevice *dev;
+	char parent[PATH_MAX];
+	Mutex::Autolock _l(mLock);
+
+	if (sysfs_path == NULL)
+		return -EINVAL;
+
+	if (realpath(sysfs_path, parent) == NULL)
+		return -ENOENT;
+
+	if (!mValid)
+		build();
+
+	dev = lookupParent(parent);
+	if (dev == NULL)
+		return -ENOENT;
+
+	strlcpy(path, dev->path, len);
+
+	return 0;
+}
+
+void InputDeviceIndex::invalidate()
+{
+	Mutex::Autolock _l(mLock);
+
+	mValid = false;
+}
+
+int InputDeviceIndex::getCount()
+{
+	Mutex::Autolock _l(mLock);
+
+	return mCount;
+}
@@ -0,0 +1,86 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_INPUT_DEVICE_INDEX_H
+#define SENSOR_INPUT_DEVICE_INDEX_H
+
+#include <limits.h>
+#include <stdint.h>
+#include <utils/Singleton.h>
+#include <utils/Mutex.h>
+
+using namespace android;
+
+#define INPUT_DEVICE_PATH	"/dev/input/"
+#define INPUT_CLASS_PATH	"/sys/class/input/"
+#define MAX_INPUT_DEVICES	64
+#define INPUT_NAME_LEN		80
+/* Power of two, at least twice MAX_INPUT_DEVICES */
+#define INPUT_HASH_SIZE		128
+
+struct InputDevice {
+	char name[INPUT_NAME_LEN]; // name reported by EVIOCGNAME
+	char path[PATH_MAX]; // the event node, /dev/input/eventX
+	char parent[PATH_MAX]; // resolved sysfs path of the parent input device
+	int next_name; // next device in the same name hash bucket
+	int next_parent; // next device in the same parent hash bucket
+};
+
+/* Index of the /dev/input event nodes. Every node is opened once to read
+ * its name, then lookups by name or by sysfs parent are hash lookups. The
+ * index is built on the first lookup and rebuilt after invalidate().
+ */
+class InputDeviceIndex : public Singleton<InputDeviceIndex> {
+	friend class Singleton<InputDeviceIndex>;
+	InputDeviceIndex();
+	~InputDeviceIndex();
+
+	Mutex mLock;
+	bool mValid;
+	int mCount;
+	struct InputDevice mDevices[MAX_INPUT_DEVICES];
+	int mNameHash[INPUT_HASH_SIZE];
+	int mParentHash[INPUT_HASH_SIZE];
+
+	void build();
+	const struct InputDevice* lookupName(const char *name);
+	const struct InputDevice* lookupParent(const char *parent);
+public:
+	/* Copy the event node of the input device called name into path.
+	 * Return 0 on success or -ENOENT.
+	 */
+	int findByName(const char *name, char *path, size_t len);
+	/* Same as findByName but match the input device sysfs_path points to */
+	int findByParent(const char *sysfs_path, char *path, size_t len);
+	/* Drop the index. Called on hotplug. */
+	void invalidate();
+	int getCount();
+};
+
+#endif
@@ -26,10 +26,150 @@ WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
 OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
 IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 --------------------------------------------------------------------------*/
+#include <stdlib.h>
+#include <time.h>
+#include <sys/utsname.h>
+#include <utils/Atomic.h>
+#include <cutils/properties.h>
 #include "NativeSensorManager.h"
+#include "EventArena.h"
 
 ANDROID_SINGLETON_STATIC_INSTANCE(NativeSensorManager);
 
+/* Shared by the discovery threads. Each thread claims the next unloaded entry. */
+struct SensorDiscoveryJob {
+	NativeSensorManager *manager;
+	struct SensorDiscoveryEntry *entries;
+	int32_t count;
+	volatile int32_t next;
+};
+
+#define DISCOVERY_CACHE_MAGIC	0x63647373 /* "ssdc" */
+#define DISCOVERY_CACHE_VERSION	1
+#define FNV1A_64_INIT		0xcbf29ce484222325ULL
+#define FNV1A_64_PRIME		0x100000001b3ULL
+
+/* On-disk layout of the discovery cache. The header is followed by "count"
+ * entries. Only fixed size types are used so the 32 and 64 bit HAL can share
+ * the same file.
+ */
+struct DiscoveryCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_size;
+	uint32_t count;
+	uint64_t fingerprint;
+	uint64_t checksum;
+	char kernel[2 * sizeof(((struct utsname*)0)->release)];
+};
+
+struct DiscoveryCacheEntry {
+	char node[SYSFS_MAXLEN];
+	char name[SYSFS_MAXLEN];
+	char vendor[SYSFS_MAXLEN];
+	char data_path[SYSFS_MAXLEN];
+	int32_t version;
+	int32_t type;
+	float max_range;
+	float resolution;
+	float power;
+	int32_t min_delay;
+	uint32_t fifo_reserved;
+	uint32_t fifo_max;
+	int64_t max_delay;
+	uint64_t flags;
+	int32_t legacy_event;
+	int32_t reserved;
+};
+
+static uint64_t fnv1a(uint64_t hash, const void *buf, size_t len)
+{
+	const unsigned char *p = (const unsigned char*)buf;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= FNV1A_64_PRIME;
+	}
+
+	return hash;
+}
+
+static void getKernelId(char *buf, size_t len)
+{
+	struct utsname u;
+
+	memset(buf, 0, len);
+	if (uname(&u))
+		return;
+
+	strlcpy(buf, u.release, len);
+	strlcat(buf, " ", len);
+	strlcat(buf, u.version, len);
+}
+
+static int64_t getBootTime()
+{
+	struct timespec t;
+
+	t.tv_sec = t.tv_nsec = 0;
+	clock_gettime(CLOCK_BOOTTIME, &t);
+	return int64_t(t.tv_sec) * 1000000000LL + t.tv_nsec;
+}
+
+/* Add one reference to v, keeping the values sorted */
+static void rateset_add(struct RateSet *set, int64_t v)
+{
+	int i;
+
+	for (i = 0; (i < set->size) && (set->value[i] < v); i++)
+		;
+
+	if ((i < set->size) && (set->value[i] == v)) {
+		set->refs[i]++;
+		return;
+	}
+
+	/* Can't happen, every listener holds at most one value */
+	if (set->size >= SENSOR_MAX_LISTENERS) {
+		ALOGE("Too many rates requested, %lld ignored\n", (long long)v);
+		return;
+	}
+
+	memmove(&set->value[i + 1], &set->value[i], (set->size - i) * sizeof(set->value[0]));
+	memmove(&set->refs[i + 1], &set->refs[i], (set->size - i) * sizeof(set->refs[0]));
+	set->value[i] = v;
+	set->refs[i] = 1;
+	set->size++;
+}
+
+static void rateset_remove(struct RateSet *set, int64_t v)
+{
+	int i;
+
+	for (i = 0; (i < set->size) && (set->value[i] != v); i++)
+		;
+
+	if (i == set->size)
+		return;
+
+	if (--set->refs[i])
+		return;
+
+	set->size--;
+	memmove(&set->value[i], &set->value[i + 1], (set->size - i) * sizeof(set->value[0]));
+	memmove(&set->refs[i], &set->refs[i + 1], (set->size - i) * sizeof(set->refs[0]));
+}
+
+static bool rateset_min(const struct RateSet *set, int64_t *min)
+{
+	if (set->size == 0)
+		return false;
+
+	*min = set->value[0];
+
+	return true;
+}
+
 enum {
 	ORIENTATION = 0,
 	PSEUDO_GYROSCOPE,
@@ -41,11 +181,10 @@ enum {
 	VIRTUAL_SENSOR_COUNT,
 };
 
-char NativeSensorManager::virtualSensorName[VIRTUAL_SENSOR_COUNT][SYSFS_MAXLEN];
 
 const struct sensor_t NativeSensorManager::virtualSensorList [VIRTUAL_SENSOR_COUNT] = {
 	[ORIENTATION] = {
-		.name = virtualSensorName[ORIENTATION],
+		.name = ORIENTATION_NAME,
 		.vendor = "oem",
 		.version = 1,
 		.handle = '_dmy',
@@ -66,7 +205,7 @@ const struct sensor_t NativeSensorManager::virtualSensorList [VIRTUAL_SENSOR_COU
 	},
 
 	[PSEUDO_GYROSCOPE] = {
-		.name = virtualSensorName[PSEUDO_GYROSCOPE],
+		.name = GYROSCOPE_NAME,
 		.vendor = "oem",
 		.version = 1,
 		.handle = '_dmy',
@@ -87,7 +226,7 @@ const struct sensor_t NativeSensorManager::virtualSensorList [VIRTUAL_SENSOR_COU
 	},
 
 	[ROTATION_VECTOR] = {
-		.name = virtualSensorName[ROTATION_VECTOR],
+		.name = ROTATION_VECTOR_NAME,
 		.vendor = "oem",
 		.version = 1,
 		.handle = '_dmy',
@@ -129,7 +268,7 @@ const struct sensor_t NativeSensorManager::virtualSensorList [VIRTUAL_SENSOR_COU
 	},
 
 	[LINEAR_ACCELERATION] = {
-		.name = virtualSensorName[LINEAR_ACCELERATION],
+		.name = LINEAR_ACCELERATION_NAME,
 		.vendor = "oem",
 		.version = 1,
 		.handle = '_dmy',
@@ -150,7 +289,7 @@ const struct sensor_t NativeSensorManager::virtualSensorList [VIRTUAL_SENSOR_COU
 	},
 
 	[GRAVITY] = {
-		.name = virtualSensorName[GRAVITY],
+		.name = GRAVITY_NAME,
 		.vendor = "oem",
 		.version = 1,
 		.handle = '_dmy',
@@ -171,7 +310,7 @@ const struct sensor_t NativeSensorManager::virtualSensorList [VIRTUAL_SENSOR_COU
 	},
 
 	[POCKET] = {
-		.name = virtualSensorName[POCKET],
+		.name = POCKET_NAME,
 		.vendor = "oem",
 		.version = 1,
 		.handle = '_dmy',
@@ -192,11 +331,53 @@ const struct sensor_t NativeSensorManager::virtualSensorList [VIRTUAL_SENSOR_COU
 	},
 };
 
+#define SENSOR_TYPE_BIT(type)	(1ULL << (type))
+
+/* The virtual sensors and the hardware types they are built from, in the
+ * order they are listed. A row is set up when all of its inputs are present
+ * and none of the excluded types is, and the calibration libraries provide
+ * an algo for it. A negative sensor copies the sensor_t of the single input,
+ * a non negative name prefixes the name with the chip name of that input.
+ * New composites only need a row here and an algo in a calibration library.
+ */
+const struct VirtualSensorDesc NativeSensorManager::virtualSensorGraph[] = {
+	{SENSOR_TYPE_POCKET, POCKET,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_PROXIMITY) | SENSOR_TYPE_BIT(SENSOR_TYPE_LIGHT),
+		0, SENSOR_TYPE_PROXIMITY},
+	/* HAL implemented orientation. Android will replace it for
+	 * platform with Gyro with SensorFusion. */
+	{SENSOR_TYPE_ORIENTATION, ORIENTATION,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_ACCELEROMETER) | SENSOR_TYPE_BIT(SENSOR_TYPE_MAGNETIC_FIELD),
+		0, SENSOR_TYPE_MAGNETIC_FIELD},
+	/* Pseudo gyroscope is a pseudo sensor which implements by accelerometer and
+	 * magnetometer. Some sensor vendors provide such implementations. The pseudo
+	 * gyroscope sensor is low cost but the performance is worse than the actual
+	 * gyroscope. So disable it and the sensors below for the system with actual
+	 * gyroscope. */
+	{SENSOR_TYPE_GYROSCOPE, PSEUDO_GYROSCOPE,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_ACCELEROMETER) | SENSOR_TYPE_BIT(SENSOR_TYPE_MAGNETIC_FIELD),
+		SENSOR_TYPE_BIT(SENSOR_TYPE_GYROSCOPE), SENSOR_TYPE_MAGNETIC_FIELD},
+	{SENSOR_TYPE_LINEAR_ACCELERATION, LINEAR_ACCELERATION,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_ACCELEROMETER) | SENSOR_TYPE_BIT(SENSOR_TYPE_MAGNETIC_FIELD),
+		SENSOR_TYPE_BIT(SENSOR_TYPE_GYROSCOPE), SENSOR_TYPE_MAGNETIC_FIELD},
+	{SENSOR_TYPE_ROTATION_VECTOR, ROTATION_VECTOR,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_ACCELEROMETER) | SENSOR_TYPE_BIT(SENSOR_TYPE_MAGNETIC_FIELD),
+		SENSOR_TYPE_BIT(SENSOR_TYPE_GYROSCOPE), SENSOR_TYPE_MAGNETIC_FIELD},
+	{SENSOR_TYPE_GRAVITY, GRAVITY,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_ACCELEROMETER) | SENSOR_TYPE_BIT(SENSOR_TYPE_MAGNETIC_FIELD),
+		SENSOR_TYPE_BIT(SENSOR_TYPE_GYROSCOPE), SENSOR_TYPE_MAGNETIC_FIELD},
+	{SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED, -1,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_MAGNETIC_FIELD), 0, -1},
+	{SENSOR_TYPE_GYROSCOPE_UNCALIBRATED, -1,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_GYROSCOPE), 0, -1},
+	{SENSOR_TYPE_GAME_ROTATION_VECTOR, GAME_ROTATION_VECTOR,
+		SENSOR_TYPE_BIT(SENSOR_TYPE_ACCELEROMETER) | SENSOR_TYPE_BIT(SENSOR_TYPE_GYROSCOPE),
+		0, -1},
+};
+
 int NativeSensorManager::addDependency(struct SensorContext *ctx, int handle)
 {
 	struct SensorContext *dep;
-	struct listnode *node;
-	struct SensorRefMap *ref, *item;
 
 	if (!ctx->is_virtual) {
 		ALOGE("Only available for virtual sensors.\n");
@@ -204,6 +385,8 @@ int NativeSensorManager::addDependency(struct SensorContext *ctx, int handle)
 	}
 
 	dep = getInfoByHandle(handle);
+	if (dep == NULL)
+		return -1;
 
 #if defined(SENSORS_DEVICE_API_VERSION_1_3)
 	if (ctx->sensor->maxDelay == 0)
@@ -213,48 +396,53 @@ int NativeSensorManager::addDependency(struct SensorContext *ctx, int handle)
 			dep->sensor->maxDelay : ctx->sensor->maxDelay;
 #endif
 
-	if (dep != NULL) {
-		list_for_each(node, &ctx->dep_list) {
-			ref = node_to_item(node, struct SensorRefMap, list);
-			if (ref->ctx == dep) {
-				ALOGW("The dependency already present");
-				return 0;
-			}
-		}
-
-		item = new SensorRefMap;
-		item->ctx = dep;
-		list_add_tail(&ctx->dep_list, &item->list);
+	/* Keep the index order a topological order, so that a bit scan of
+	 * any mask visits the dependencies before their dependents.
+	 */
+	if (indexOf(dep) >= indexOf(ctx)) {
+		ALOGE("%s must be set up before %s\n", dep->sensor->name, ctx->sensor->name);
+		return -1;
+	}
 
+	if (DEPEND_ON(ctx->dep, indexOf(dep))) {
+		ALOGW("The dependency already present");
 		return 0;
 	}
 
-	return -1;
+	ctx->dep |= SENSOR_BIT(indexOf(dep));
+
+	return 0;
 }
 
 int NativeSensorManager::initVirtualSensor(struct SensorContext *ctx, int handle,
 		struct sensor_t info)
 {
 	CalibrationManager& cm(CalibrationManager::getInstance());
-	SensorRefMap *item;
 	struct SensorContext *ref;
 	unsigned int i;
 
+	if (ctx - context >= mCapacity) {
+		ALOGE("No room for virtual sensor %s\n", info.name);
+		return -1;
+	}
+
 	*(ctx->sensor) = info;
 	if (cm.getCalAlgo(ctx->sensor) == NULL) {
 		return -1;
 	}
 
+	/* The driver and its buffer are only created while enabled */
 	ctx->sensor->handle = handle;
-	ctx->driver = new VirtualSensor(ctx);
+	ctx->driver = NULL;
 	ctx->data_fd = -1;
 	ctx->is_virtual = true;
 
-	memset(ctx->enable_path, 0, sizeof(ctx->enable_path));
-	memset(ctx->data_path, 0, sizeof(ctx->data_path));
+	ctx->info->name = ctx->sensor->name;
+	ctx->info->vendor = ctx->sensor->vendor;
+	ctx->info->enable_path = mStrings.intern("");
+	ctx->info->data_path = ctx->info->enable_path;
 
-	type_map.add(ctx->sensor->type, ctx);
-	handle_map.add(ctx->sensor->handle, ctx);
+	setInfoByType(ctx->sensor->type, ctx);
 
 	return 0;
 }
@@ -283,69 +471,52 @@ const struct SysfsMap NativeSensorManager::node_map[] = {
 };
 
 NativeSensorManager::NativeSensorManager():
-	mSensorCount(0), mScanned(false), mEventCount(0), type_map(NULL), handle_map(NULL), fd_map(NULL)
+	sensor_list(NULL), context(NULL), info_list(NULL), rate_list(NULL), pick_list(NULL), batch_list(NULL),
+	mCapacity(0),
+	mSensorCount(0), mDiscoveryTime(0), mDiscoveryThreads(0),
+	mDiscoveryCached(false), mHotplugFd(-1), mEventWd(-1), mSysfsWd(-1),
+	private_type_map(NULL), fd_table(NULL), mFdTableSize(0)
 {
-	int i;
-
-	memset(sensor_list, 0, sizeof(sensor_list));
-	memset(context, 0, sizeof(context));
-
-	type_map.setCapacity(MAX_SENSORS);
-	handle_map.setCapacity(MAX_SENSORS);
-	fd_map.setCapacity(MAX_SENSORS);
-
-	for (i = 0; i < MAX_SENSORS; i++) {
-		context[i].sensor = &sensor_list[i];
-		sensor_list[i].name = context[i].name;
-		sensor_list[i].vendor = context[i].vendor;
-		list_init(&context[i].listener);
-		list_init(&context[i].dep_list);
-	}
+	memset(type_table, 0, sizeof(type_table));
 
 	if(getDataInfo()) {
 		ALOGE("Get data info failed\n");
 	}
 
+	setupHotplug();
+
 	dump();
 }
 
 NativeSensorManager::~NativeSensorManager()
 {
 	int i;
-	int number = getSensorCount();
-	struct listnode *node;
-	struct listnode *n;
-	struct SensorContext *ctx;
-	struct SensorRefMap *item;
 
-	for (i = 0; i < number; i++) {
+	if (mHotplugFd >= 0)
+		close(mHotplugFd);
+
+	/* Dependents go before the sensors they depend on */
+	for (i = mSensorCount - 1; i >= 0; i--) {
 		if (context[i].driver != NULL) {
 			delete context[i].driver;
 		}
-
-		list_for_each_safe(node, n, &context[i].listener) {
-			item = node_to_item(node, struct SensorRefMap, list);
-			if (item != NULL) {
-				list_remove(&item->list);
-				delete item;
-			}
-		}
-
-		list_for_each_safe(node, n, &context[i].dep_list) {
-			item = node_to_item(node, struct SensorRefMap, list);
-			if (item != NULL) {
-				list_remove(&item->list);
-				delete item;
-			}
-		}
 	}
+
+	free(context);
+	delete [] fd_table;
+	delete [] info_list;
+	delete [] rate_list;
+	delete [] pick_list;
+	for (i = 0; i < mCapacity; i++)
+		delete [] batch_list[i].buffer;
+	delete [] batch_list;
+	delete [] sensor_list;
 }
 
 void NativeSensorManager::dump()
 {
-	int i;
-	struct listnode *node;
-	struct SensorRefMap* ref;
+	int i, j;
+	uint64_t mask;
 
 	for (i = 0; i < mSensorCount; i++) {
 		ALOGI("\nname:%s\ntype:%d\nhandle:%d\ndata_fd=%d\nis_virtual=%d",
@@ -356,8 +527,8 @@ void NativeSensorManager::dump()
 				context[i].is_virtual);
 
 		ALOGI("data_path=%s\nenable_path=%s\ndelay_ns:%lld\nenable=%d\n",
-				context[i].data_path,
-				context[i].enable_path,
+				context[i].info->data_path,
+				context[i].info->enable_path,
 				context[i].delay_ns,
 				context[i].enable);
 
@@ -370,18 +541,23 @@ void NativeSensorManager::dump()
 
 
 		ALOGI("Listener:");
-		list_for_each(node, &context[i].listener) {
-			ref = node_to_item(node, struct SensorRefMap, list);
-			ALOGI("name:%s handle:%d\n", ref->ctx->sensor->name, ref->ctx->sensor->handle);
-		}
+		for_each_sensor_bit(j, mask, context[i].listener)
+			ALOGI("name:%s handle:%d\n", context[j].sensor->name, context[j].sensor->handle);
 
 		ALOGI("Dependency:");
-		list_for_each(node, &context[i].dep_list) {
-			ref = node_to_item(node, struct SensorRefMap, list);
-			ALOGI("name:%s handle:%d", ref->ctx->sensor->name, ref->ctx->sensor->handle);
-		}
+		for_each_sensor_bit(j, mask, context[i].dep)
+			ALOGI("name:%s handle:%d", context[j].sensor->name, context[j].sensor->handle);
+
+		if (context[i].is_virtual && (context[i].driver != NULL))
+			ALOGI("dropped=%u\n", static_cast<VirtualSensor*>(context[i].driver)->getDropped());
 	}
 
+	ALOGI("discovery took %lld us with %d threads%s\n", (long long)(mDiscoveryTime / 1000),
+			mDiscoveryThreads, mDiscoveryCached ? " (cached)" : "");
+	ALOGI("%d sensors, room for %d, %zu bytes of strings\n", mSensorCount, mCapacity,
+			mStrings.size());
+	ALOGI("event arena: %d chunks in use, %d allocated\n",
+			EventArena::getInstance().getInUse(), EventArena::getInstance().getTotal());
 	ALOGI("\n");
 }
 
@@ -400,202 +576,240 @@ void NativeSensorManager::compositeVirtualSensorName(const char *sensor_name, ch
 	strlcat(chip_name, type_to_name(type), SYSFS_MAXLEN);
 }
 
-int NativeSensorManager::getDataInfo() {
-	int i, j;
-	struct SensorContext *list;
-	int has_acc = 0;
-	int has_compass = 0;
-	int has_gyro = 0;
-	int has_light = 0;
-	int has_proximity = 0;
-	struct sensor_t sensor_mag;
-	struct sensor_t sensor_acc;
-	struct sensor_t sensor_light;
-	struct sensor_t sensor_proximity;
-	struct sensor_t sensor_gyro;
+/* Set up the tables and the driver for a newly discovered hardware sensor */
+int NativeSensorManager::initHardwareSensor(struct SensorContext *list)
+{
+	list->is_virtual = false;
 
-	mSensorCount = getSensorListInner();
-	for (i = 0; i < mSensorCount; i++) {
-		struct SensorRefMap *item;
-		list = &context[i];
-		list->is_virtual = false;
+	/* hardware sensor depend on itself */
+	list->dep = SENSOR_BIT(indexOf(list));
 
-		item = new struct SensorRefMap;
-		item->ctx = list;
-		/* hardware sensor depend on itself */
-		list_add_tail(&list->dep_list, &item->list);
+	setInfoByType(list->sensor->type, list);
 
-		if (strlen(list->data_path) != 0)
-			list->data_fd = open(list->data_path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
-		else
-			list->data_fd = -1;
+	return attachDriver(list);
+}
 
-		if (list->data_fd > 0) {
-			fd_map.add(list->data_fd, list);
-		} else {
-			ALOGE("open %s failed, continue anyway.(%s)\n", list->data_path, strerror(errno));
+void NativeSensorManager::setInfoByType(int type, struct SensorContext *ctx)
+{
+	if ((unsigned int)type < SENSOR_TYPE_TABLE_SIZE)
+		type_table[type] = ctx;
+	else
+		private_type_map.add(type, ctx);
+}
+
+void NativeSensorManager::setInfoByFd(int fd, struct SensorContext *ctx)
+{
+	struct SensorContext **table;
+	int size;
+
+	if (fd < 0)
+		return;
+
+	if (fd >= mFdTableSize) {
+		if (ctx == NULL)
+			return;
+
+		size = mFdTableSize ? mFdTableSize : 32;
+		while (size <= fd)
+			size *= 2;
+
+		table = new struct SensorContext*[size]();
+		if (fd_table != NULL) {
+			memcpy(table, fd_table, mFdTableSize * sizeof(*table));
+			delete [] fd_table;
 		}
+		fd_table = table;
+		mFdTableSize = size;
+	}
+
+	fd_table[fd] = ctx;
+}
+
+/* Forget the settings written to the driver so the next sync rewrites them */
+void NativeSensorManager::invalidateRates(const struct SensorContext *ctx)
+{
+	rate_list[indexOf(ctx)].programmed_delay = -1;
+	rate_list[indexOf(ctx)].programmed_latency = -1;
+}
+
+/* Open the data node of a hardware sensor and create its driver */
+int NativeSensorManager::attachDriver(struct SensorContext *list)
+{
+	invalidateRates(list);
+
+	if (strlen(list->info->data_path) != 0)
+		list->data_fd = open(list->info->data_path, O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+	else
+		list->data_fd = -1;
+
+	if (list->data_fd > 0) {
+		setInfoByFd(list->data_fd, list);
+	} else {
+		ALOGE("open %s failed, continue anyway.(%s)\n", list->info->data_path, strerror(errno));
+	}
 
-		type_map.add(list->sensor->type, list);
-		handle_map.add(list->sensor->handle, list);
-
-		switch (list->sensor->type) {
-			case SENSOR_TYPE_ACCELEROMETER:
-				has_acc = 1;
-				list->driver = new AccelSensor(list);
-				sensor_acc = *(list->sensor);
-				break;
-			case SENSOR_TYPE_MAGNETIC_FIELD:
-				has_compass = 1;
-				list->driver = new CompassSensor(list);
-				sensor_mag = *(list->sensor);
-				break;
-			case SENSOR_TYPE_PROXIMITY:
-				has_proximity = 1;
+	switch (list->sensor->type) {
+		case SENSOR_TYPE_ACCELEROMETER:
+			list->driver = new AccelSensor(list);
+			break;
+		case SENSOR_TYPE_MAGNETIC_FIELD:
+			list->driver = new CompassSensor(list);
+			break;
+		case SENSOR_TYPE_PROXIMITY:
 #if defined(SENSORS_DEVICE_API_VERSION_1_3)
-				/* reporting mode fix up */
-				list->sensor->flags |= SENSOR_FLAG_ON_CHANGE_MODE;
+			/* reporting mode fix up */
+			list->sensor->flags |= SENSOR_FLAG_ON_CHANGE_MODE;
 #endif
-				list->driver = new ProximitySensor(list);
-				sensor_proximity = *(list->sensor);
-				break;
-			case SENSOR_TYPE_LIGHT:
-				has_light = 1;
+			list->driver = new ProximitySensor(list);
+			break;
+		case SENSOR_TYPE_LIGHT:
 #if defined(SENSORS_DEVICE_API_VERSION_1_3)
-				/* reporting mode fix up */
-				list->sensor->flags |= SENSOR_FLAG_ON_CHANGE_MODE;
+			/* reporting mode fix up */
+			list->sensor->flags |= SENSOR_FLAG_ON_CHANGE_MODE;
 #endif
-				list->driver = new LightSensor(list);
-				sensor_light = *(list->sensor);
-				break;
-			case SENSOR_TYPE_GYROSCOPE:
-				has_gyro = 1;
-				list->driver = new GyroSensor(list);
-				sensor_gyro = *(list->sensor);
-				break;
-			case SENSOR_TYPE_PRESSURE:
-				list->driver = new PressureSensor(list);
-				break;
-			case SENSOR_TYPE_SIGNIFICANT_MOTION:
-				list->driver = new SmdSensor(list);
-				break;
-			default:
-				list->driver = NULL;
-				ALOGE("No handle %d for this type sensor!", i);
-				break;
-		}
-		initCalibrate(list);
+			list->driver = new LightSensor(list);
+			break;
+		case SENSOR_TYPE_GYROSCOPE:
+			list->driver = new GyroSensor(list);
+			break;
+		case SENSOR_TYPE_PRESSURE:
+			list->driver = new PressureSensor(list);
+			break;
+		case SENSOR_TYPE_SIGNIFICANT_MOTION:
+			list->driver = new SmdSensor(list);
+			break;
+		default:
+			list->driver = NULL;
+			ALOGE("No handle %d for this type sensor!", list->sensor->handle);
+			return -1;
 	}
+	initCalibrate(list);
 
-	/* Some vendor or the reference design implements some virtual sensors
-	 * or pseudo sensors. These sensors are required by some of the applications.
-	 * Here we check the CalibratoinManager to decide whether to enable them.
-	 */
-	CalibrationManager &cm(CalibrationManager::getInstance());
-	struct SensorRefMap *ref;
-	char *chip;
-
-	if (has_light && has_proximity) {
-		compositeVirtualSensorName(sensor_proximity.name, virtualSensorName[POCKET], SENSOR_TYPE_POCKET);
-		ALOGD("pocket virtual sensor name changed to %s\n", virtualSensorName[POCKET]);
-		if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-				virtualSensorList[POCKET])) {
-			addDependency(&context[mSensorCount], sensor_proximity.handle);
-			addDependency(&context[mSensorCount], sensor_light.handle);
-			mSensorCount++;
-		}
-	}
+	return 0;
+}
 
-	if (has_acc && has_compass) {
-		compositeVirtualSensorName(sensor_mag.name, virtualSensorName[ORIENTATION], SENSOR_TYPE_ORIENTATION);
-		ALOGD("orientation virtual sensor name changed to %s\n", virtualSensorName[ORIENTATION]);
-		/* HAL implemented orientation. Android will replace it for
-		 * platform with Gyro with SensorFusion.
-		 * The calibration manager will first match "oem-orientation" and
-		 * then match "orientation" to select the algorithms. */
-		if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-					virtualSensorList[ORIENTATION])) {
-			addDependency(&context[mSensorCount], sensor_acc.handle);
-			addDependency(&context[mSensorCount], sensor_mag.handle);
-			mSensorCount++;
-		}
+/* Tear down the driver of a hardware sensor whose device is gone. The sensor
+ * keeps its handle and listeners so it can be attached again later.
+ */
+void NativeSensorManager::detachDriver(struct SensorContext *list)
+{
+	if (list->data_fd > 0)
+		setInfoByFd(list->data_fd, NULL);
 
-		if (!has_gyro) {
-			compositeVirtualSensorName(sensor_mag.name, virtualSensorName[ORIENTATION], SENSOR_TYPE_ORIENTATION);
-			ALOGD("orientation virtual sensor name changed to %s\n", virtualSensorName[ORIENTATION]);
-			/* Pseudo gyroscope is a pseudo sensor which implements by accelerometer and
-			 * magnetometer. Some sensor vendors provide such implementations. The pseudo
-			 * gyroscope sensor is low cost but the performance is worse than the actual
-			 * gyroscope. So disable it for the system with actual gyroscope. */
-			if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-						virtualSensorList[PSEUDO_GYROSCOPE])) {
-				addDependency(&context[mSensorCount], sensor_acc.handle);
-				addDependency(&context[mSensorCount], sensor_mag.handle);
-				mSensorCount++;
-			}
+	/* The driver owns and closes the data fd */
+	delete list->driver;
+	list->driver = NULL;
+	list->data_fd = -1;
 
-			compositeVirtualSensorName(sensor_mag.name, virtualSensorName[LINEAR_ACCELERATION], SENSOR_TYPE_LINEAR_ACCELERATION);
-			ALOGD("liear acceleration virtual sensor name changed to %s\n", virtualSensorName[LINEAR_ACCELERATION]);
-			/* For linear acceleration */
-			if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-						virtualSensorList[LINEAR_ACCELERATION])) {
-				addDependency(&context[mSensorCount], sensor_acc.handle);
-				addDependency(&context[mSensorCount], sensor_mag.handle);
-				mSensorCount++;
-			}
+	/* Nothing can read the held samples anymore */
+	resetBatch(list);
+}
 
-			compositeVirtualSensorName(sensor_mag.name, virtualSensorName[ROTATION_VECTOR], SENSOR_TYPE_ROTATION_VECTOR);
-			ALOGD("rotation vector virtual sensor name changed to %s\n", virtualSensorName[ROTATION_VECTOR]);
-			/* For rotation vector */
-			if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-						virtualSensorList[ROTATION_VECTOR])) {
-				addDependency(&context[mSensorCount], sensor_acc.handle);
-				addDependency(&context[mSensorCount], sensor_mag.handle);
-				mSensorCount++;
-			}
+/* Allocate the sensor tables once the number of sensors is known. They are
+ * never reallocated since the framework keeps the sensor_list pointer and
+ * the drivers and the maps keep pointers into context.
+ */
+void NativeSensorManager::allocTables(int capacity)
+{
+	const char *empty = mStrings.intern("");
+	void *mem = NULL;
+	int i;
 
-			compositeVirtualSensorName(sensor_mag.name, virtualSensorName[GRAVITY], SENSOR_TYPE_GRAVITY);
-			ALOGD("gravity virtual sensor name changed to %s\n", virtualSensorName[GRAVITY]);
-			/* For gravity */
-			if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-						virtualSensorList[GRAVITY])) {
-				addDependency(&context[mSensorCount], sensor_acc.handle);
-				addDependency(&context[mSensorCount], sensor_mag.handle);
-				mSensorCount++;
-			}
-		}
+	/* The dependency masks have one bit per sensor */
+	if (capacity > SENSOR_MASK_BITS) {
+		ALOGW("%d sensors requested, only %d supported\n", capacity, SENSOR_MASK_BITS);
+		capacity = SENSOR_MASK_BITS;
 	}
 
-	if (has_compass) {
-		/* The uncalibrated magnetic field sensor shares the same vendor/name as the
-		 * calibrated one. */
-		sensor_mag.type = SENSOR_TYPE_MAGNETIC_FIELD_UNCALIBRATED;
-		if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-					sensor_mag)) {
-			addDependency(&context[mSensorCount], sensor_mag.handle);
-			mSensorCount++;
-		}
+	mCapacity = capacity;
+	sensor_list = new struct sensor_t[capacity]();
+	info_list = new struct SensorInfo[capacity];
+	rate_list = new struct SensorRates[capacity]();
+	pick_list = new struct SensorPicker[capacity]();
+	batch_list = new struct SoftBatch[capacity]();
+
+	/* new doesn't honor the cache line alignment */
+	if (posix_memalign(&mem, SENSOR_CACHE_LINE, capacity * sizeof(struct SensorContext))) {
+		ALOGE("allocate %d sensor contexts failed\n", capacity);
+		abort();
+	}
+	context = (struct SensorContext*)mem;
+	memset(context, 0, capacity * sizeof(struct SensorContext));
+
+
+	for (i = 0; i < capacity; i++) {
+		context[i].sensor = &sensor_list[i];
+		context[i].info = &info_list[i];
+		invalidateRates(&context[i]);
+		info_list[i].name = empty;
+		info_list[i].vendor = empty;
+		info_list[i].enable_path = empty;
+		info_list[i].data_path = empty;
+		sensor_list[i].name = empty;
+		sensor_list[i].vendor = empty;
 	}
+}
+
+int NativeSensorManager::getDataInfo() {
+	int i, j;
+	uint64_t mask;
+	uint64_t present = 0;
+	struct SensorContext *list;
+	struct SensorContext *input[SENSOR_TYPE_TABLE_SIZE];
+	const struct VirtualSensorDesc *desc;
+	struct sensor_t sensor;
+	char name[SYSFS_MAXLEN];
+
+	memset(input, 0, sizeof(input));
+
+	mSensorCount = getSensorListInner();
+	for (i = 0; i < mSensorCount; i++) {
+		list = &context[i];
+		initHardwareSensor(list);
 
-	if (has_gyro) {
-		sensor_gyro.type = SENSOR_TYPE_GYROSCOPE_UNCALIBRATED;
-		if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-					sensor_gyro)) {
-			addDependency(&context[mSensorCount], sensor_gyro.handle);
-			mSensorCount++;
+		if ((unsigned int)list->sensor->type < SENSOR_TYPE_TABLE_SIZE) {
+			present |= SENSOR_TYPE_BIT(list->sensor->type);
+			input[list->sensor->type] = list;
 		}
 	}
 
-	if (has_acc && has_gyro) {
-		/* For game rotation vector */
-		if (!initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount),
-					virtualSensorList[GAME_ROTATION_VECTOR])) {
-			addDependency(&context[mSensorCount], sensor_acc.handle);
-			addDependency(&context[mSensorCount], sensor_gyro.handle);
-			mSensorCount++;
+	/* Some vendor or the reference design implements some virtual sensors
+	 * or pseudo sensors. These sensors are required by some of the applications.
+	 * Here we check the CalibratoinManager to decide whether to enable them.
+	 */
+	for (i = 0; i < (int)ARRAY_SIZE(virtualSensorGraph); i++) {
+		desc = &virtualSensorGraph[i];
+		if (((present & desc->inputs) != desc->inputs) || (present & desc->excludes))
+			continue;
+
+		if (desc->sensor >= 0) {
+			sensor = virtualSensorList[desc->sensor];
+		} else {
+			/* Shares the same vendor/name as the input */
+			sensor = *(input[__builtin_ctzll(desc->inputs)]->sensor);
+			sensor.type = desc->type;
+		}
+
+		/* The calibration manager will first match "oem-orientation" and
+		 * then match "orientation" to select the algorithms. */
+		if (desc->name >= 0) {
+			compositeVirtualSensorName(input[desc->name]->sensor->name, name, desc->type);
+			sensor.name = mStrings.intern(name);
+			ALOGD("%s virtual sensor name changed to %s\n", type_to_name(desc->type), sensor.name);
 		}
+
+		if (initVirtualSensor(&context[mSensorCount], SENSORS_HANDLE(mSensorCount), sensor))
+			continue;
+
+		for_each_sensor_bit(j, mask, desc->inputs)
+			addDependency(&context[mSensorCount], input[j]->sensor->handle);
+		mSensorCount++;
 	}
 
+	/* After the virtual sensors copied the hardware FIFO sizes */
+	for (i = 0; i < mSensorCount; i++)
+		setupSoftBatch(&context[i]);
+
 	return 0;
 }
 
@@ -606,22 +820,15 @@ int NativeSensorManager::getDataInfo() {
  */
 int NativeSensorManager::registerListener(struct SensorContext *hw, struct SensorContext *virt)
 {
-	struct listnode *node;
-	struct SensorContext *ctx;
-	struct SensorRefMap *item;
-
-	list_for_each(node, &hw->listener) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		if (item->ctx->sensor->handle == virt->sensor->handle) {
-			ALOGE("Already registered as listener for %s:%s\n", hw->sensor->name, virt->sensor->name);
-			return -1;
-		}
+	if (hw->listener & SENSOR_BIT(indexOf(virt))) {
+		ALOGE("Already registered as listener for %s:%s\n", hw->sensor->name, virt->sensor->name);
+		return -1;
 	}
 
-	item = new SensorRefMap;
-	item->ctx = virt;
-
-	list_add_tail(&hw->listener, &item->list);
+	hw->listener |= SENSOR_BIT(indexOf(virt));
+	addRequest(hw, virt);
+	/* Take the next sample whatever the phase of the previous session */
+	memset(&pick_list[indexOf(virt)], 0, sizeof(pick_list[0]));
 
 	return 0;
 }
@@ -629,18 +836,10 @@ int NativeSensorManager::registerListener(struct SensorContext *hw, struct Senso
 /* Remove the virtual sensor listener from the list specified by "hw" */
 int NativeSensorManager::unregisterListener(struct SensorContext *hw, struct SensorContext *virt)
 {
-	struct listnode *node;
-	struct listnode *n;
-	struct SensorContext *ctx;
-	struct SensorRefMap *item;
-
-	list_for_each_safe(node, n, &hw->listener) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		if (item->ctx == virt) {
-			list_remove(&item->list);
-			delete item;
-			return 0;
-		}
+	if (hw->listener & SENSOR_BIT(indexOf(virt))) {
+		hw->listener &= ~SENSOR_BIT(indexOf(virt));
+		removeRequest(hw, virt);
+		return 0;
 	}
 
 	ALOGE("%s is not a listener of %s\n", virt->sensor->name, hw->sensor->name);
@@ -653,27 +852,26 @@ int NativeSensorManager::getSensorList(const sensor_t **list) {
 	return mSensorCount;
 }
 
-int NativeSensorManager::getNode(char *buf, char *path, const struct SysfsMap *map) {
-	char * fret;
+int NativeSensorManager::getNode(char *buf, int dirfd, const struct SysfsMap *map) {
 	ssize_t len = 0;
 	int fd;
 	char tmp[SYSFS_MAXLEN];
 
-	if (NULL == buf || NULL == path)
+	if (NULL == buf || dirfd < 0)
 		return -1;
 
 	memset(tmp, 0, sizeof(tmp));
 
-	fd = open(path, O_RDONLY);
+	fd = openat(dirfd, map->node, O_RDONLY);
 	if (fd < 0) {
-		ALOGE("open %s failed.(%s)\n", path, strerror(errno));
+		ALOGE("open %s failed.(%s)\n", map->node, strerror(errno));
 		/* Ignore unrequired nodes for backward compatiblity */
 		return map->required ? -1 : 0;
 	}
 
 	len = read(fd, tmp, sizeof(tmp) - 1);
 	if ((len <= 0) || (strlen(tmp) == 0)) {
-		ALOGE("read %s failed.(%s)\n", path, strerror(errno));
+		ALOGE("read %s failed.(%s)\n", map->node, strerror(errno));
 		close(fd);
 
 		/* Ignore unrequired nodes for backward compatiblity */
@@ -703,95 +901,95 @@ int NativeSensorManager::getNode(char *buf, char *path, const struct SysfsMap *m
 	return 0;
 }
 
-int NativeSensorManager::getEventPathOld(const struct SensorContext *list, char *event_path)
+/* Load all the attributes of one sysfs sensor node. The node directory is
+ * opened once and every attribute is read relative to it, so no path is
+ * walked more than once. This is called from the discovery threads and must
+ * not touch any state shared with other entries.
+ */
+int NativeSensorManager::loadSensorNode(struct SensorDiscoveryEntry *entry)
 {
-	struct dirent **namelist;
-	char *file;
-	char path[PATH_MAX];
-	char name[80];
-	int nNodes;
-	int fd = -1;
-	int j;
+	char devname[PATH_MAX];
+	unsigned int i;
+	int dirfd;
 
-	/* scan "/dev/input" to get information */
-	if (!mScanned) {
-		strlcpy(path, EVENT_PATH, sizeof(path));
-		file = path + strlen(EVENT_PATH);
-		nNodes = scandir(path, &namelist, 0, alphasort);
-		if (nNodes < 0) {
-			ALOGE("scan %s failed.(%s)\n", EVENT_PATH, strerror(errno));
-			return -1;
+	entry->err = -1;
+	entry->event_err = -1;
+	entry->sensor.name = entry->name;
+	entry->sensor.vendor = entry->vendor;
+
+	strlcpy(devname, SYSFS_CLASS, sizeof(devname));
+	strlcat(devname, entry->node, sizeof(devname));
+
+	dirfd = open(devname, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) {
+		ALOGE("open %s failed.(%s)\n", devname, strerror(errno));
+		return -1;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(node_map); i++) {
+		if (getNode((char*)&entry->sensor, dirfd, &node_map[i])) {
+			ALOGE("Get node %s for %s failed.\n", node_map[i].node, devname);
+			break;
 		}
+	}
+	close(dirfd);
 
-		for (mEventCount = 0, j = 0; (j < nNodes) && (j < MAX_SENSORS); j++) {
-			if (namelist[j]->d_type != DT_CHR) {
-				continue;
-			}
+	if (i < ARRAY_SIZE(node_map))
+		return -1;
 
-			strlcpy(file, namelist[j]->d_name, sizeof(path) - strlen(EVENT_PATH));
+	entry->err = 0;
 
-			fd = open(path, O_RDONLY);
-			if (fd < 0) {
-				ALOGE("open %s failed(%s)", path, strerror(errno));
-				continue;
-			}
+	if (!((1ULL << entry->sensor.type) & SUPPORTED_SENSORS_TYPE))
+		return 0;
 
-			if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
-				name[0] = '\0';
-			}
+	/* initialize data path */
+	strlcat(devname, "/device", sizeof(devname));
+	entry->event_err = getEventPath(devname, entry->data_path);
 
-			strlcpy(event_list[mEventCount].data_name, name, sizeof(event_list[0].data_name));
-			strlcpy(event_list[mEventCount].data_path, path, sizeof(event_list[0].data_path));
-			close(fd);
-			mEventCount++;
-		}
+	return 0;
+}
 
-		for (j = 0; j <nNodes; j++ ) {
-			free(namelist[j]);
-		}
+void* NativeSensorManager::discoveryThread(void *arg)
+{
+	struct SensorDiscoveryJob *job = (struct SensorDiscoveryJob*)arg;
+	int32_t i;
 
-		free(namelist);
-		mScanned = true;
-	}
+	while ((i = android_atomic_inc(&job->next)) < job->count)
+		job->manager->loadSensorNode(&job->entries[i]);
 
-	/* Initialize data_path and data_fd */
-	for (j = 0; (j < mEventCount) && (j < MAX_SENSORS); j++) {
-		if (strcmp(list->sensor->name, event_list[j].data_name) == 0) {
-			strlcpy(event_path, event_list[j].data_path, PATH_MAX);
-			break;
-		}
+	return NULL;
+}
 
-		if (strcmp(event_list[j].data_name, type_to_name(list->sensor->type)) == 0) {
-			strlcpy(event_path, event_list[j].data_path, PATH_MAX);
-		}
-	}
+int NativeSensorManager::getEventPathOld(const struct SensorContext *list, char *event_path)
+{
+	InputDeviceIndex& index(InputDeviceIndex::getInstance());
+
+	/* Match the sensor name first, then the generic name of its type */
+	if (index.findByName(list->sensor->name, event_path, PATH_MAX) == 0)
+		return 0;
+
+	index.findByName(type_to_name(list->sensor->type), event_path, PATH_MAX);
 
 	return 0;
 }
 
 int NativeSensorManager::getEventPath(const char *sysfs_path, char *event_path)
 {
-	DIR *dir;
-	struct dirent *de;
 	char symlink[PATH_MAX];
 	int len;
 	char *needle;
 
-	dir = opendir(sysfs_path);
-	if (dir == NULL) {
-		ALOGE("open %s failed.(%s)\n", strerror(errno));
-		return -1;
-	}
 	if ((sysfs_path == NULL) || (event_path == NULL)) {
 		ALOGE("invalid NULL argument.");
 		return -EINVAL;
 	}
 
-	len = readlink(sysfs_path, symlink, PATH_MAX);
+	len = readlink(sysfs_path, symlink, PATH_MAX - 1);
 	if (len < 0) {
 		ALOGE("readlink failed for %s(%s)\n", sysfs_path, strerror(errno));
 		return -1;
 	}
+	symlink[len] = '\0';
 
 	needle = strrchr(symlink, '/');
 	if (needle == NULL) {
@@ -811,39 +1009,39 @@ int NativeSensorManager::getEventPath(const char *sysfs_path, char *event_path)
 		return -ENODEV;
 	}
 
-	strlcpy(event_path, EVENT_PATH, PATH_MAX);
-
-	while ((de = readdir(dir))) {
-		if (strncmp(de->d_name, "event", strlen("event")) == 0) {
-			strlcat(event_path, de->d_name, sizeof(de->d_name));
-			break;
-		}
+	/* The event node is the one whose parent is the same input device */
+	if (InputDeviceIndex::getInstance().findByParent(sysfs_path, event_path, PATH_MAX)) {
+		ALOGE("no event node found for %s\n", sysfs_path);
+		return -1;
 	}
 
-	closedir(dir);
-
 	return 0;
 }
 
-int NativeSensorManager::getSensorListInner()
+/* Enumerate SYSFS_CLASS and load the attributes of every node into entries.
+ * Return the number of entries filled in.
+ */
+int NativeSensorManager::scanSensorNodes(struct SensorDiscoveryEntry *entries, int max)
 {
-	int number = 0;
-	int err = -1;
 	const char *dirname = SYSFS_CLASS;
-	char devname[PATH_MAX];
-	char *filename;
-	char *nodename;
 	DIR *dir;
 	struct dirent *de;
-	struct SensorContext *list;
-	unsigned int i;
+	struct SensorDiscoveryEntry *entry;
+	struct SensorDiscoveryJob job;
+	pthread_t threads[DISCOVERY_THREADS - 1];
+	int nthreads = 0;
+	int err;
+	int i;
 
 	dir = opendir(dirname);
 	if(dir == NULL) {
 		return 0;
 	}
-	strlcpy(devname, dirname, PATH_MAX);
-	filename = devname + strlen(devname);
+
+	job.manager = this;
+	job.entries = entries;
+	job.count = 0;
+	job.next = 0;
 
 	while ((de = readdir(dir))) {
 		if(de->d_name[0] == '.' &&
@@ -851,61 +1049,683 @@ int NativeSensorManager::getSensorListInner()
 				(de->d_name[1] == '.' && de->d_name[2] == '\0')))
 			continue;
 
-		list = &context[number];
+		if (job.count >= max) {
+			ALOGE("Too many sensors under %s, ignore %s\n", dirname, de->d_name);
+			continue;
+		}
 
-		strlcpy(filename, de->d_name, PATH_MAX - strlen(SYSFS_CLASS));
-		nodename = filename + strlen(de->d_name);
-		*nodename++ = '/';
+		entry = &job.entries[job.count++];
+		memset(entry, 0, sizeof(*entry));
+		strlcpy(entry->node, de->d_name, sizeof(entry->node));
+	}
+	closedir(dir);
 
-		for (i = 0; i < ARRAY_SIZE(node_map); i++) {
-			strlcpy(nodename, node_map[i].node, PATH_MAX - strlen(SYSFS_CLASS) - strlen(de->d_name));
-			err = getNode((char*)(list->sensor), devname, &node_map[i]);
-			if (err) {
-				ALOGE("Get node for %s failed.\n", devname);
-				break;
-			}
+	/* The calling thread takes part in the discovery as well */
+	for (i = 0; (i < DISCOVERY_THREADS - 1) && (i < job.count - 1); i++) {
+		err = pthread_create(&threads[nthreads], NULL, discoveryThread, &job);
+		if (err) {
+			ALOGE("create discovery thread failed.(%s)\n", strerror(err));
+			break;
 		}
+		nthreads++;
+	}
 
-		if (i < ARRAY_SIZE(node_map))
-			continue;
+	discoveryThread(&job);
 
-		if (!((1ULL << list->sensor->type) & SUPPORTED_SENSORS_TYPE))
-			continue;
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
 
-		/* Setup other information */
-#if defined(SENSORS_DEVICE_API_VERSION_1_3)
-		if (list->sensor->maxDelay == 0)
-			list->sensor->maxDelay = 10000000;
+	mDiscoveryThreads = nthreads + 1;
+
+	return job.count;
+}
+
+/* Fill the sensor context for each usable entry. Return the number of sensors. */
+int NativeSensorManager::commitDiscovery(struct SensorDiscoveryEntry *entries, int count, int base)
+{
+	int number = 0;
+	struct SensorContext *list;
+	struct SensorDiscoveryEntry *entry;
+	char path[PATH_MAX];
+	int i;
+
+	/* Keep the sysfs enumeration order for the handle assignment */
+	for (i = 0; i < count; i++) {
+		entry = &entries[i];
+
+		if (entry->err)
+			continue;
+
+		if (!((1ULL << entry->sensor.type) & SUPPORTED_SENSORS_TYPE))
+			continue;
+
+		if (base + number >= mCapacity) {
+			ALOGE("No room for sensor %s\n", entry->name);
+			break;
+		}
+
+		list = &context[base + number];
+
+		list->info->name = mStrings.intern(entry->name);
+		list->info->vendor = mStrings.intern(entry->vendor);
+		*(list->sensor) = entry->sensor;
+		list->sensor->name = list->info->name;
+		list->sensor->vendor = list->info->vendor;
+
+		/* Setup other information */
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+		if (list->sensor->maxDelay == 0)
+			list->sensor->maxDelay = 10000000;
 		else
 			list->sensor->maxDelay = list->sensor->maxDelay * 1000; /* milliseconds to microseconds */
 #endif
-		list->sensor->handle = SENSORS_HANDLE(number);
-
-		strlcpy(nodename, "", SYSFS_MAXLEN);
-		strlcpy(list->enable_path, devname, PATH_MAX);
+		list->sensor->handle = SENSORS_HANDLE(base + number);
 
-		/* initialize data path */
-		strlcpy(nodename, "device", SYSFS_MAXLEN);
+		strlcpy(path, SYSFS_CLASS, sizeof(path));
+		strlcat(path, entry->node, sizeof(path));
+		strlcat(path, "/", sizeof(path));
+		list->info->enable_path = mStrings.intern(path);
 
-		if (getEventPath(devname, list->data_path) == -ENODEV) {
-			getEventPathOld(list, list->data_path);
+		if ((entry->event_err == -ENODEV) && !entry->cached) {
+			/* Remember the result for the discovery cache */
+			getEventPathOld(list, entry->data_path);
 		}
+		list->info->data_path = mStrings.intern(entry->data_path);
 
 		number++;
 	}
+
+	return number;
+}
+
+/* A cheap fingerprint of the sysfs sensor class: the name of each node and
+ * the device it links to. A sensor added, removed or moved changes it.
+ */
+uint64_t NativeSensorManager::getSysfsFingerprint(int *nodes)
+{
+	uint64_t hash = FNV1A_64_INIT;
+	char path[PATH_MAX];
+	char target[PATH_MAX];
+	DIR *dir;
+	struct dirent *de;
+	ssize_t len;
+
+	*nodes = 0;
+
+	dir = opendir(SYSFS_CLASS);
+	if (dir == NULL)
+		return 0;
+
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		(*nodes)++;
+		hash = fnv1a(hash, de->d_name, strlen(de->d_name) + 1);
+
+		strlcpy(path, SYSFS_CLASS, sizeof(path));
+		strlcat(path, de->d_name, sizeof(path));
+		len = readlink(path, target, sizeof(target));
+		if (len > 0)
+			hash = fnv1a(hash, target, len);
+	}
 	closedir(dir);
+
+	return hash;
+}
+
+/* Restore the discovered sensors from DISCOVERY_CACHE_PATH.
+ * Return the number of entries restored, or -1 if the cache is missing or
+ * doesn't match the running system.
+ */
+int NativeSensorManager::loadDiscoveryCache(struct SensorDiscoveryEntry *entries, int max,
+		uint64_t fingerprint)
+{
+	struct DiscoveryCacheHeader header;
+	struct DiscoveryCacheEntry *cache;
+	struct SensorDiscoveryEntry *entry;
+	char kernel[sizeof(header.kernel)];
+	char path[PATH_MAX];
+	const char *event;
+	uint64_t checksum;
+	ssize_t len;
+	int fd;
+	int i;
+
+	fd = open(DISCOVERY_CACHE_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		ALOGI("No discovery cache at %s.(%s)\n", DISCOVERY_CACHE_PATH, strerror(errno));
+		return -1;
+	}
+
+	len = read(fd, &header, sizeof(header));
+	if ((len != sizeof(header)) || (header.magic != DISCOVERY_CACHE_MAGIC) ||
+			(header.version != DISCOVERY_CACHE_VERSION) ||
+			(header.entry_size != sizeof(struct DiscoveryCacheEntry)) ||
+			(header.count > (uint32_t)max) || (header.count == 0)) {
+		ALOGW("Invalid discovery cache header\n");
+		close(fd);
+		return -1;
+	}
+
+	getKernelId(kernel, sizeof(kernel));
+	header.kernel[sizeof(header.kernel) - 1] = '\0';
+	if (strcmp(kernel, header.kernel) || (fingerprint != header.fingerprint)) {
+		ALOGI("Discovery cache is stale\n");
+		close(fd);
+		return -1;
+	}
+
+	cache = new DiscoveryCacheEntry[header.count];
+	len = read(fd, cache, header.count * sizeof(struct DiscoveryCacheEntry));
+	close(fd);
+
+	checksum = fnv1a(FNV1A_64_INIT, cache, header.count * sizeof(struct DiscoveryCacheEntry));
+	if ((len != (ssize_t)(header.count * sizeof(struct DiscoveryCacheEntry))) ||
+			(checksum != header.checksum)) {
+		ALOGW("Corrupted discovery cache\n");
+		delete [] cache;
+		return -1;
+	}
+
+	for (i = 0; i < (int)header.count; i++) {
+		entry = &entries[i];
+		memset(entry, 0, sizeof(*entry));
+
+		cache[i].node[sizeof(cache[i].node) - 1] = '\0';
+		cache[i].name[sizeof(cache[i].name) - 1] = '\0';
+		cache[i].vendor[sizeof(cache[i].vendor) - 1] = '\0';
+		cache[i].data_path[sizeof(cache[i].data_path) - 1] = '\0';
+
+		/* The event node number may change when the probe order changes */
+		event = strrchr(cache[i].data_path, '/');
+		if (cache[i].legacy_event || (event == NULL)) {
+			strlcpy(path, cache[i].data_path, sizeof(path));
+		} else {
+			strlcpy(path, SYSFS_CLASS, sizeof(path));
+			strlcat(path, cache[i].node, sizeof(path));
+			strlcat(path, "/device", sizeof(path));
+			strlcat(path, event, sizeof(path));
+		}
+
+		if ((cache[i].data_path[0] != '\0') && access(path, F_OK)) {
+			ALOGI("Discovery cache mismatch on %s\n", path);
+			delete [] cache;
+			return -1;
+		}
+
+		strlcpy(entry->node, cache[i].node, sizeof(entry->node));
+		strlcpy(entry->name, cache[i].name, sizeof(entry->name));
+		strlcpy(entry->vendor, cache[i].vendor, sizeof(entry->vendor));
+		strlcpy(entry->data_path, cache[i].data_path, sizeof(entry->data_path));
+		entry->sensor.name = entry->name;
+		entry->sensor.vendor = entry->vendor;
+		entry->sensor.version = cache[i].version;
+		entry->sensor.type = cache[i].type;
+		entry->sensor.maxRange = cache[i].max_range;
+		entry->sensor.resolution = cache[i].resolution;
+		entry->sensor.power = cache[i].power;
+		entry->sensor.minDelay = cache[i].min_delay;
+		entry->sensor.fifoReservedEventCount = cache[i].fifo_reserved;
+		entry->sensor.fifoMaxEventCount = cache[i].fifo_max;
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+		entry->sensor.maxDelay = cache[i].max_delay;
+		entry->sensor.flags = cache[i].flags;
+#endif
+		entry->event_err = cache[i].legacy_event ? -ENODEV : 0;
+		entry->cached = true;
+	}
+
+	delete [] cache;
+
+	return header.count;
+}
+
+/* Store the usable entries to DISCOVERY_CACHE_PATH for the next boot */
+int NativeSensorManager::saveDiscoveryCache(const struct SensorDiscoveryEntry *entries, int count,
+		uint64_t fingerprint)
+{
+	struct DiscoveryCacheHeader header;
+	struct DiscoveryCacheEntry *cache;
+	const struct SensorDiscoveryEntry *entry;
+	char tmp[PATH_MAX];
+	ssize_t len;
+	size_t size;
+	int number = 0;
+	int fd;
+	int i;
+
+	if (fingerprint == 0)
+		return -1;
+
+	cache = new DiscoveryCacheEntry[count > 0 ? count : 1];
+	memset(cache, 0, sizeof(struct DiscoveryCacheEntry) * (count > 0 ? count : 1));
+
+	for (i = 0; i < count; i++) {
+		entry = &entries[i];
+
+		if (entry->err || !((1ULL << entry->sensor.type) & SUPPORTED_SENSORS_TYPE))
+			continue;
+
+		/* Only cache what the compact layout can hold */
+		if ((strlen(entry->node) >= sizeof(cache[0].node)) ||
+				(strlen(entry->data_path) >= sizeof(cache[0].data_path))) {
+			ALOGW("%s doesn't fit the discovery cache\n", entry->node);
+			delete [] cache;
+			return -1;
+		}
+
+		strlcpy(cache[number].node, entry->node, sizeof(cache[0].node));
+		strlcpy(cache[number].name, entry->name, sizeof(cache[0].name));
+		strlcpy(cache[number].vendor, entry->vendor, sizeof(cache[0].vendor));
+		strlcpy(cache[number].data_path, entry->data_path, sizeof(cache[0].data_path));
+		cache[number].version = entry->sensor.version;
+		cache[number].type = entry->sensor.type;
+		cache[number].max_range = entry->sensor.maxRange;
+		cache[number].resolution = entry->sensor.resolution;
+		cache[number].power = entry->sensor.power;
+		cache[number].min_delay = entry->sensor.minDelay;
+		cache[number].fifo_reserved = entry->sensor.fifoReservedEventCount;
+		cache[number].fifo_max = entry->sensor.fifoMaxEventCount;
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+		cache[number].max_delay = entry->sensor.maxDelay;
+		cache[number].flags = entry->sensor.flags;
+#endif
+		cache[number].legacy_event = (entry->event_err == -ENODEV);
+		number++;
+	}
+
+	if (number == 0) {
+		delete [] cache;
+		return -1;
+	}
+
+	size = number * sizeof(struct DiscoveryCacheEntry);
+	memset(&header, 0, sizeof(header));
+	header.magic = DISCOVERY_CACHE_MAGIC;
+	header.version = DISCOVERY_CACHE_VERSION;
+	header.entry_size = sizeof(struct DiscoveryCacheEntry);
+	header.count = number;
+	header.fingerprint = fingerprint;
+	header.checksum = fnv1a(FNV1A_64_INIT, cache, size);
+	getKernelId(header.kernel, sizeof(header.kernel));
+
+	if (mkdir(DISCOVERY_CACHE_DIR, 0770) && (errno != EEXIST)) {
+		ALOGW("create %s failed.(%s)\n", DISCOVERY_CACHE_DIR, strerror(errno));
+		delete [] cache;
+		return -1;
+	}
+
+	strlcpy(tmp, DISCOVERY_CACHE_PATH, sizeof(tmp));
+	strlcat(tmp, ".tmp", sizeof(tmp));
+	fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0660);
+	if (fd < 0) {
+		ALOGW("open %s failed.(%s)\n", tmp, strerror(errno));
+		delete [] cache;
+		return -1;
+	}
+
+	len = write(fd, &header, sizeof(header));
+	if (len == sizeof(header))
+		len = write(fd, cache, size);
+	close(fd);
+	delete [] cache;
+
+	if ((len != (ssize_t)size) || rename(tmp, DISCOVERY_CACHE_PATH)) {
+		ALOGW("write %s failed.(%s)\n", DISCOVERY_CACHE_PATH, strerror(errno));
+		unlink(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+int NativeSensorManager::getSensorListInner()
+{
+	struct SensorDiscoveryEntry *entries;
+	uint64_t fingerprint;
+	int64_t start = getBootTime();
+	char value[PROPERTY_VALUE_MAX];
+	bool cache;
+	int nodes;
+	int count;
+	int number;
+
+	/* The cache needs DISCOVERY_CACHE_DIR created and labeled by the device
+	 * init.rc and sepolicy, and /data ready before the HAL starts. Devices
+	 * that provide this turn it on with ro.sensors.discovery_cache=1.
+	 */
+	property_get("ro.sensors.discovery_cache", value, "0");
+	cache = (atoi(value) != 0);
+
+	fingerprint = getSysfsFingerprint(&nodes);
+	entries = new SensorDiscoveryEntry[nodes > 0 ? nodes : 1];
+
+	/* Skip the enumeration if nothing changed since the last boot */
+	count = cache ? loadDiscoveryCache(entries, nodes, fingerprint) : -1;
+	if (count >= 0) {
+		mDiscoveryCached = true;
+		mDiscoveryThreads = 1;
+	} else {
+		count = scanSensorNodes(entries, nodes);
+	}
+
+	allocTables(count + (int)ARRAY_SIZE(virtualSensorGraph) + HOTPLUG_SPARE_SENSORS);
+	number = commitDiscovery(entries, count, 0);
+
+	if (cache && !mDiscoveryCached)
+		saveDiscoveryCache(entries, count, fingerprint);
+
+	delete [] entries;
+
+	mDiscoveryTime = getBootTime() - start;
+
 	return number;
 }
 
+/* Watch for sensors coming and going. Sysfs doesn't reliably report new
+ * class devices to inotify, so /dev/input is the main trigger: every sensor
+ * driver registers an input device along with the sensors class device.
+ */
+int NativeSensorManager::setupHotplug()
+{
+	mHotplugFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mHotplugFd < 0) {
+		ALOGE("inotify_init1 failed.(%s)\n", strerror(errno));
+		return -1;
+	}
+
+	mEventWd = inotify_add_watch(mHotplugFd, EVENT_PATH, IN_CREATE | IN_DELETE | IN_ATTRIB);
+	if (mEventWd < 0)
+		ALOGE("watch %s failed.(%s)\n", EVENT_PATH, strerror(errno));
+
+	mSysfsWd = inotify_add_watch(mHotplugFd, SYSFS_CLASS, IN_CREATE | IN_DELETE);
+	if (mSysfsWd < 0)
+		ALOGW("watch %s failed.(%s)\n", SYSFS_CLASS, strerror(errno));
+
+	return 0;
+}
+
+struct SensorContext* NativeSensorManager::findSensorNode(const char *node)
+{
+	char path[PATH_MAX];
+	int i;
+
+	strlcpy(path, SYSFS_CLASS, sizeof(path));
+	strlcat(path, node, sizeof(path));
+	strlcat(path, "/", sizeof(path));
+
+	for (i = 0; i < mSensorCount; i++) {
+		if (!context[i].is_virtual && (strcmp(context[i].info->enable_path, path) == 0))
+			return &context[i];
+	}
+
+	return NULL;
+}
+
+/* Bring back a hardware sensor whose device showed up again */
+int NativeSensorManager::reattachSensor(struct SensorContext *list)
+{
+	char path[PATH_MAX];
+	char data_path[PATH_MAX];
+
+	memset(data_path, 0, sizeof(data_path));
+	strlcpy(path, list->info->enable_path, sizeof(path));
+	strlcat(path, "device", sizeof(path));
+	if (getEventPath(path, data_path) == -ENODEV)
+		getEventPathOld(list, data_path);
+	list->info->data_path = mStrings.intern(data_path);
+
+	if (attachDriver(list))
+		return -1;
+
+	ALOGI("%s is attached\n", list->sensor->name);
+
+	/* Restore the state requested by the listeners */
+	if (list->listener) {
+		syncDelay(list->sensor->handle);
+		syncLatency(list->sensor->handle);
+		list->driver->enable(list->sensor->handle, 1);
+	}
+
+	return 0;
+}
+
+/* Append a hardware sensor probed after the HAL started */
+int NativeSensorManager::addHotplugSensor(const char *node)
+{
+	struct SensorDiscoveryEntry entry;
+	struct SensorContext *list;
+
+	if (mSensorCount >= mCapacity) {
+		ALOGE("No room for new sensor %s\n", node);
+		return -ENOSPC;
+	}
+
+	memset(&entry, 0, sizeof(entry));
+	strlcpy(entry.node, node, sizeof(entry.node));
+	if (loadSensorNode(&entry) || entry.err)
+		return -EINVAL;
+
+	if (commitDiscovery(&entry, 1, mSensorCount) != 1)
+		return -EINVAL;
+
+	list = &context[mSensorCount];
+	mSensorCount++;
+	initHardwareSensor(list);
+	setupSoftBatch(list);
+
+	ALOGI("%s is added with handle %d\n", list->sensor->name, list->sensor->handle);
+
+	return 0;
+}
+
+/* Attach the sensor of the SYSFS_CLASS node, adding it if it is new.
+ * Return 1 if a sensor was attached or added.
+ */
+int NativeSensorManager::attachSensorNode(const char *node)
+{
+	struct SensorContext *list = findSensorNode(node);
+	String8 name(node);
+
+	if (list == NULL) {
+		if (mRejected.indexOf(name) >= 0)
+			return 0;
+		if (addHotplugSensor(node) == -EINVAL) {
+			mRejected.add(name);
+			return 0;
+		}
+		return (findSensorNode(node) != NULL) ? 1 : 0;
+	}
+
+	/* Already up, or its device isn't there */
+	if (((list->driver != NULL) && (list->data_fd >= 0)) ||
+			access(list->info->enable_path, F_OK))
+		return 0;
+
+	/* The data node wasn't accessible before */
+	if (list->driver != NULL)
+		detachDriver(list);
+
+	return reattachSensor(list) ? 0 : 1;
+}
+
+/* A node was created or removed under SYSFS_CLASS */
+int NativeSensorManager::handleSysfsEvent(uint32_t mask, const char *node)
+{
+	struct SensorContext *list;
+
+	if (mask & IN_CREATE)
+		return attachSensorNode(node);
+
+	/* A node loading fine next time is a new device, probe it again */
+	mRejected.remove(String8(node));
+
+	list = findSensorNode(node);
+	if ((list == NULL) || (list->driver == NULL))
+		return 0;
+
+	ALOGI("%s is removed\n", list->sensor->name);
+	detachDriver(list);
+
+	return 1;
+}
+
+/* An event node was created, removed or had its permissions changed under
+ * EVENT_PATH. Only the sensors of that input device are looked at.
+ */
+int NativeSensorManager::handleInputEvent(uint32_t mask, const char *name)
+{
+	char path[PATH_MAX];
+	struct SensorContext *list;
+	DIR *dir;
+	struct dirent *de;
+	int changed = 0;
+	int i;
+
+	if (strncmp(name, "event", strlen("event")) != 0)
+		return 0;
+
+	/* The /dev/input names indexed before are stale now */
+	InputDeviceIndex::getInstance().invalidate();
+
+	if (mask & IN_DELETE) {
+		snprintf(path, sizeof(path), EVENT_PATH "%s", name);
+		for (i = 0; i < mSensorCount; i++) {
+			list = &context[i];
+			if (list->is_virtual || (list->driver == NULL) ||
+					strcmp(list->info->data_path, path))
+				continue;
+
+			ALOGI("%s is removed\n", list->sensor->name);
+			detachDriver(list);
+			changed++;
+		}
+		return changed;
+	}
+
+	/* The sensors class devices are children of the input device, next to
+	 * its event node.
+	 */
+	snprintf(path, sizeof(path), INPUT_CLASS_PATH "%s/device", name);
+	dir = opendir(path);
+	if (dir == NULL)
+		return 0;
+
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		snprintf(path, sizeof(path), SYSFS_CLASS "%s", de->d_name);
+		if (access(path, F_OK))
+			continue;
+
+		changed += attachSensorNode(de->d_name);
+	}
+	closedir(dir);
+
+	return changed;
+}
+
+/* Check every sensor and SYSFS_CLASS node. Only used when inotify lost
+ * events, the others are handled one node at a time.
+ */
+int NativeSensorManager::rescanHotplug()
+{
+	struct SensorContext *list;
+	DIR *dir;
+	struct dirent *de;
+	int changed = 0;
+	int i;
+
+	InputDeviceIndex::getInstance().invalidate();
+	mRejected.clear();
+
+	for (i = 0; i < mSensorCount; i++) {
+		list = &context[i];
+		if (list->is_virtual)
+			continue;
+
+		if (access(list->info->enable_path, F_OK)) {
+			if (list->driver != NULL) {
+				ALOGI("%s is removed\n", list->sensor->name);
+				detachDriver(list);
+				changed++;
+			}
+			continue;
+		}
+
+		/* The device is back, or its data node wasn't accessible before */
+		if ((list->driver == NULL) || (list->data_fd < 0)) {
+			if (list->driver != NULL)
+				detachDriver(list);
+			if (!reattachSensor(list))
+				changed++;
+		}
+	}
+
+	dir = opendir(SYSFS_CLASS);
+	if (dir == NULL)
+		return changed;
+
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		if (findSensorNode(de->d_name) != NULL)
+			continue;
+
+		changed += attachSensorNode(de->d_name);
+	}
+	closedir(dir);
+
+	return changed;
+}
+
+/* Called on the poll thread when the hotplug fd is readable.
+ * Return the number of sensors attached, detached or added.
+ */
+int NativeSensorManager::handleHotplug()
+{
+	char buf[HOTPLUG_BUF_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	ssize_t len;
+	char *p;
+	int changed = 0;
+
+	if (mHotplugFd < 0)
+		return 0;
+
+	while ((len = read(mHotplugFd, buf, sizeof(buf))) > 0) {
+		for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+			event = (const struct inotify_event *)p;
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				ALOGW("hotplug events lost, rescanning\n");
+				changed += rescanHotplug();
+				continue;
+			}
+
+			if ((event->len == 0) || (event->name[0] == '.'))
+				continue;
+
+			if (event->wd == mSysfsWd)
+				changed += handleSysfsEvent(event->mask, event->name);
+			else if (event->wd == mEventWd)
+				changed += handleInputEvent(event->mask, event->name);
+		}
+	}
+
+	return changed;
+}
+
 int NativeSensorManager::activate(int handle, int enable)
 {
 	SensorContext *list;
 	int i;
-	int number = getSensorCount();
 	int err = 0;
-	struct listnode *node;
-	struct SensorContext *ctx;
-	struct SensorRefMap *item;
+	uint64_t mask;
+	struct SensorContext *dep;
 
 	ALOGD("activate called handle:%d enable:%d", handle, enable);
 
@@ -916,49 +1736,59 @@ int NativeSensorManager::activate(int handle, int enable)
 	}
 
 	list->enable = enable;
+	if (!enable)
+		resetBatch(list);
+
+	if (list->is_virtual && enable && (list->driver == NULL))
+		list->driver = new VirtualSensor(list);
 
 	/* one shot sensors don't act as base sensors */
 	if (list->sensor->flags & SENSOR_FLAG_ONE_SHOT_MODE)
-		return list->driver->enable(handle, enable);
+		return list->driver ? list->driver->enable(handle, enable) : -ENODEV;
 
 	/* Search for the background sensor for the sensor specified by handle. */
-	list_for_each(node, &list->dep_list) {
-		item = node_to_item(node, struct SensorRefMap, list);
+	for_each_sensor_bit(i, mask, list->dep) {
+		dep = &context[i];
 		if (enable) {
-			registerListener(item->ctx, list);
+			registerListener(dep, list);
 
 #if defined(SENSORS_DEVICE_API_VERSION_1_3)
 			/* HAL 1.3 already set listener's delay and latency
 			 * Sync it right now to make it take effect.
 			 */
-			syncDelay(item->ctx->sensor->handle);
-			syncLatency(item->ctx->sensor->handle);
+			syncDelay(dep->sensor->handle);
+			syncLatency(dep->sensor->handle);
 #endif
 
-			/* Enable the background sensor and register a listener on it. */
-			ALOGD("%s calling driver enable", item->ctx->sensor->name);
-			item->ctx->driver->enable(item->ctx->sensor->handle, 1);
+			/* Enable the background sensor and register a listener on it.
+			 * A detached sensor is enabled again when it comes back.
+			 */
+			ALOGD("%s calling driver enable", dep->sensor->name);
+			if (dep->driver != NULL)
+				dep->driver->enable(dep->sensor->handle, 1);
 
 		} else {
 			/* The background sensor has other listeners, we need
 			 * to unregister the current sensor from it and sync the
 			 * poll delay settings.
 			 */
-			if (!list_empty(&item->ctx->listener)) {
-				unregisterListener(item->ctx, list);
+			if (dep->listener) {
+				unregisterListener(dep, list);
 				/* restore delay settings */
-				syncDelay(item->ctx->sensor->handle);
+				syncDelay(dep->sensor->handle);
 
 #if defined(SENSORS_DEVICE_API_VERSION_1_3)
 				/* restore latency settings */
-				syncLatency(item->ctx->sensor->handle);
+				syncLatency(dep->sensor->handle);
 #endif
 			}
 
 			/* Disable the background sensor if it doesn't have any listeners. */
-			if (list_empty(&item->ctx->listener)) {
-				ALOGD("%s calling driver disable", item->ctx->sensor->name);
-				item->ctx->driver->enable(item->ctx->sensor->handle, 0);
+			if ((dep->listener == 0) && (dep->driver != NULL)) {
+				ALOGD("%s calling driver disable", dep->sensor->name);
+				dep->driver->enable(dep->sensor->handle, 0);
+				/* The driver may forget the settings once disabled */
+				invalidateRates(dep);
 			}
 
 		}
@@ -967,7 +1797,14 @@ int NativeSensorManager::activate(int handle, int enable)
 	/* Settings change notification */
 	if (list->is_virtual) {
 		ALOGD("%s calling driver %s", list->sensor->name, enable ? "enable" : "disable");
-		list->driver->enable(handle, enable);
+		if (list->driver != NULL)
+			list->driver->enable(handle, enable);
+
+		/* Nothing is left to report once disabled, free the buffer */
+		if (!enable) {
+			delete list->driver;
+			list->driver = NULL;
+		}
 	}
 
 	return err;
@@ -975,11 +1812,10 @@ int NativeSensorManager::activate(int handle, int enable)
 
 int NativeSensorManager::syncDelay(int handle)
 {
-	const SensorRefMap *item;
-	SensorContext *ctx;
 	const SensorContext *list;
-	struct listnode *node;
+	struct SensorRates *rates;
 	int64_t min_ns;
+	int err;
 
 	list = getInfoByHandle(handle);
 	if (list == NULL) {
@@ -987,40 +1823,35 @@ int NativeSensorManager::syncDelay(int handle)
 		return -EINVAL;
 	}
 
-	if (list_empty(&list->listener))
+	if (list->listener == 0)
 		return 0;
 
-	node = list_head(&list->listener);
-	item = node_to_item(node, struct SensorRefMap, list);
-	min_ns = item->ctx->delay_ns;
-
-	list_for_each(node, &list->listener) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		ctx = item->ctx;
-		/* To handle some special case that the polling delay is 0. This
-		 * may happen if the background sensor is not enabled but the virtual
-		 * sensor is enabled case.
-		 */
-		if (ctx->delay_ns == 0) {
-			ALOGD("%s delay is 0. continue...", ctx->sensor->name);
-			continue;
-		}
+	/* Listeners with a 0 delay are not in the set. This may happen if the
+	 * background sensor is not enabled but the virtual sensor is enabled.
+	 */
+	rates = &rate_list[indexOf(list)];
+	if (!rateset_min(&rates->delay, &min_ns))
+		return 0;
 
-		if (min_ns > ctx->delay_ns)
-			min_ns = ctx->delay_ns;
-	}
+	if (list->driver == NULL)
+		return -ENODEV;
+
+	if (min_ns == rates->programmed_delay)
+		return 0;
 
 	ALOGD("%s calling driver setDelay %d ms\n", list->sensor->name, min_ns / 1000000);
-	return list->driver->setDelay(list->sensor->handle, min_ns);
+	err = list->driver->setDelay(list->sensor->handle, min_ns);
+	rates->programmed_delay = err ? -1 : min_ns;
+
+	return err;
 }
 
 int NativeSensorManager::syncLatency(int handle)
 {
-	const SensorRefMap *item;
-	SensorContext *ctx;
 	const SensorContext *list;
-	struct listnode *node;
+	struct SensorRates *rates;
 	int64_t min_ns;
+	int err = 0;
 
 	list = getInfoByHandle(handle);
 	if (list == NULL) {
@@ -1028,27 +1859,69 @@ int NativeSensorManager::syncLatency(int handle)
 		return -EINVAL;
 	}
 
-	if (list_empty(&list->listener))
+	if (list->listener == 0)
+		return 0;
+
+	rates = &rate_list[indexOf(list)];
+	if (!rateset_min(&rates->latency, &min_ns))
 		return 0;
 
-	node = list_head(&list->listener);
-	item = node_to_item(node, struct SensorRefMap, list);
-	min_ns = item->ctx->latency_ns;
+	/* A FIFO emulated by the HAL has nothing to program */
+	if (list->sensor->fifoMaxEventCount && !list->soft_fifo && (list->driver != NULL) &&
+			(min_ns != rates->programmed_latency)) {
+		ALOGD("%s calling driver setLatency %d ms\n", list->sensor->name, min_ns / 1000000);
+		err = list->driver->setLatency(list->sensor->handle, min_ns);
+		/* Retried on the next sync if it failed */
+		rates->programmed_latency = err ? -1 : min_ns;
+	}
 
-	list_for_each(node, &list->listener) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		ctx = item->ctx;
+	return err;
+}
+
+/* Change the rate requested by ctx, keeping the aggregates of the sensors
+ * it listens to up to date.
+ */
+void NativeSensorManager::setRequest(struct SensorContext *ctx, int64_t delay_ns, int64_t latency_ns)
+{
+	uint64_t mask;
+	uint64_t bit = SENSOR_BIT(indexOf(ctx));
+	int i;
 
-		if (min_ns > ctx->latency_ns)
-			min_ns = ctx->latency_ns;
+	for_each_sensor_bit(i, mask, ctx->dep) {
+		if (context[i].listener & bit)
+			removeRequest(&context[i], ctx);
 	}
 
-	if (list->sensor->fifoMaxEventCount) {
-		ALOGD("%s calling driver setLatency %d ms\n", list->sensor->name, min_ns / 1000000);
-		list->driver->setLatency(list->sensor->handle, min_ns);
+	ctx->delay_ns = delay_ns;
+	ctx->latency_ns = latency_ns;
+
+	/* The fusion worker reads the period without the lock */
+	if (ctx->is_virtual && (ctx->driver != NULL))
+		ctx->driver->setDelay(ctx->sensor->handle, delay_ns);
+
+	for_each_sensor_bit(i, mask, ctx->dep) {
+		if (context[i].listener & bit)
+			addRequest(&context[i], ctx);
 	}
+}
 
-	return 0;
+void NativeSensorManager::addRequest(struct SensorContext *hw, const struct SensorContext *ctx)
+{
+	struct SensorRates *rates = &rate_list[indexOf(hw)];
+
+	/* A 0 delay doesn't ask for any rate */
+	if (ctx->delay_ns)
+		rateset_add(&rates->delay, ctx->delay_ns);
+	rateset_add(&rates->latency, ctx->latency_ns);
+}
+
+void NativeSensorManager::removeRequest(struct SensorContext *hw, const struct SensorContext *ctx)
+{
+	struct SensorRates *rates = &rate_list[indexOf(hw)];
+
+	if (ctx->delay_ns)
+		rateset_remove(&rates->delay, ctx->delay_ns);
+	rateset_remove(&rates->latency, ctx->latency_ns);
 }
 
 int NativeSensorManager::setDelay(int handle, int64_t ns)
@@ -1056,8 +1929,8 @@ int NativeSensorManager::setDelay(int handle, int64_t ns)
 	SensorContext *list;
 	int i;
 	int64_t delay = ns;
-	struct SensorRefMap *item;
-	struct listnode *node;
+	uint64_t mask;
+	int j;
 
 	ALOGD("setDelay called handle:%d sample_ns:%lld", handle, ns);
 
@@ -1078,58 +1951,317 @@ int NativeSensorManager::setDelay(int handle, int64_t ns)
 
 	if (ns < list->sensor->minDelay * 1000) {
 		ALOGW("%s delay is less than minDelay. Cast it to minDelay", list->sensor->name);
-		list->delay_ns = list->sensor->minDelay * 1000;
-	} else {
-		list->delay_ns = delay;
+		delay = list->sensor->minDelay * 1000;
 	}
 
-	list_for_each(node, &list->dep_list) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		syncDelay(item->ctx->sensor->handle);
+	setRequest(list, delay, list->latency_ns);
+
+	for_each_sensor_bit(j, mask, list->dep) {
+		syncDelay(context[j].sensor->handle);
 	}
 
 	return 0;
 }
 
+/* Only continuous sensors are decimated, on-change ones report too seldom */
+bool NativeSensorManager::isContinuous(const struct SensorContext *ctx)
+{
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+	return (ctx->sensor->flags & REPORTING_MODE_MASK) == SENSOR_FLAG_CONTINUOUS_MODE;
+#else
+	return (ctx->sensor->type != SENSOR_TYPE_LIGHT) &&
+		(ctx->sensor->type != SENSOR_TYPE_PROXIMITY);
+#endif
+}
+
+/* The picker of listener for the samples of hw, or NULL if there is none */
+int64_t* NativeSensorManager::getPicker(const struct SensorContext *listener,
+		const struct SensorContext *hw)
+{
+	int slot = __builtin_popcountll(listener->dep & (SENSOR_BIT(indexOf(hw)) - 1));
+
+	if (slot >= SENSOR_MAX_DEPS)
+		return NULL;
+
+	return &pick_list[indexOf(listener)].next[slot];
+}
+
+/* Phase aligned sample picker. Let one sample through per period, on the
+ * grid set by the first sample taken. tol absorbs the jitter of the
+ * hardware timestamps.
+ */
+static inline bool pick_sample(int64_t *next, const sensors_event_t *event,
+		int64_t period, int64_t tol)
+{
+	/* flush complete events always go through */
+	if (event->type == SENSOR_TYPE_META_DATA)
+		return true;
+
+	if (event->timestamp < *next - tol)
+		return false;
+
+	*next += period;
+	/* First sample or a gap in the stream, start over from this one */
+	if (*next <= event->timestamp - tol)
+		*next = event->timestamp + period;
+
+	return true;
+}
+
 int NativeSensorManager::readEvents(int handle, sensors_event_t* data, int count)
 {
 	const SensorContext *list;
 	int i, j;
-	int number = getSensorCount();
+	int n;
 	int nb;
-	struct listnode *node;
-	struct SensorRefMap *item;
+	uint64_t mask;
+	uint64_t listener;
+	struct SensorContext *ctx;
+	struct SoftBatch *batch;
+	sensors_event_t *buf;
+	int room = count;
+	int64_t period;
+	int64_t *next;
+	bool decimate;
 
 	list = getInfoByHandle(handle);
 	if (list == NULL) {
 		ALOGE("Invalid handle(%d)", handle);
 		return -EINVAL;
 	}
+
+	/* The sensor went away while its fd was in the poll set */
+	if (list->driver == NULL)
+		return 0;
+
+	/* Samples held for a batching request are read straight into the
+	 * batch buffer. Release them first once they are due.
+	 */
+	batch = getBatch(list);
+	if (batch != NULL) {
+		if (batchDue(batch, list->latency_ns, getBootTime()))
+			return drainBatch(batch, data, count);
+		buf = batchSpan(batch, &room);
+	} else {
+		buf = data;
+	}
+
 	do {
-		nb = list->driver->readEvents(data, count);
+		nb = list->driver->readEvents(buf, room);
 	} while ((nb == -EAGAIN) || (nb == -EINTR));
 
-	for (j = 0; j < nb; j++) {
-		list_for_each(node, &list->listener) {
-			item = node_to_item(node, struct SensorRefMap, list);
-			if (item->ctx->enable && (item->ctx != list)) {
-				item->ctx->driver->injectEvents(&data[j], 1);
+	if (nb <= 0)
+		return list->enable ? nb : 0;
+
+	/* The hardware runs at the fastest rate requested. Slower consumers
+	 * only get the samples picked for their own rate.
+	 */
+	period = rate_list[indexOf(list)].programmed_delay;
+	decimate = (period > 0) && isContinuous(list);
+
+	/* Hand the whole span to each listener at once. Listeners are
+	 * numbered after the sensors they depend on.
+	 */
+	listener = list->listener & ~SENSOR_BIT(indexOf(list));
+	for_each_sensor_bit(i, mask, listener) {
+		ctx = &context[i];
+		if (!ctx->enable || (ctx->driver == NULL))
+			continue;
+
+		next = getPicker(ctx, list);
+		if (!decimate || (ctx->delay_ns <= period) || (next == NULL)) {
+			ctx->driver->injectEvents(buf, nb);
+			continue;
+		}
+
+		for (j = 0, n = 0; j < nb; j++) {
+			if (pick_sample(next, &buf[j], ctx->delay_ns, period / 2))
+				mFanout[n++] = buf[j];
+
+			if ((n == SENSOR_FANOUT_EVENTS) || ((j == nb - 1) && n)) {
+				ctx->driver->injectEvents(mFanout, n);
+				n = 0;
 			}
 		}
 	}
 
-	if (list->enable)
-		return nb;
-
 	/* No need to report the events if the sensor is not enabled */
-	return 0;
+	if (!list->enable)
+		return 0;
+
+	/* Drop the samples the framework didn't ask for */
+	next = getPicker(list, list);
+	if (decimate && (list->delay_ns > period) && (next != NULL)) {
+		for (i = 0, n = 0; i < nb; i++) {
+			if (pick_sample(next, &buf[i], list->delay_ns, period / 2))
+				buf[n++] = buf[i];
+		}
+		nb = n;
+	}
+
+	if (batch != NULL) {
+		commitBatch(batch, buf, nb, list->latency_ns);
+		if (batchDue(batch, list->latency_ns, getBootTime()))
+			return drainBatch(batch, data, count);
+		return 0;
+	}
+
+	return nb;
+}
+
+/* The batch buffer of ctx if it is batching in software, NULL otherwise */
+struct SoftBatch* NativeSensorManager::getBatch(const struct SensorContext *ctx)
+{
+	struct SoftBatch *batch;
+
+	if (!ctx->soft_fifo)
+		return NULL;
+
+	batch = &batch_list[indexOf(ctx)];
+	if ((batch->count == 0) && ((ctx->latency_ns == 0) || !ctx->enable))
+		return NULL;
+
+	if (batch->buffer == NULL)
+		batch->buffer = new sensors_event_t[SOFT_FIFO_EVENTS];
+
+	return batch;
+}
+
+bool NativeSensorManager::batchDue(const struct SoftBatch *batch, int64_t latency_ns, int64_t now)
+{
+	if (batch->count == 0)
+		return false;
+
+	return batch->flush || (batch->count >= SOFT_FIFO_EVENTS) ||
+		(latency_ns == 0) || (now >= batch->deadline);
+}
+
+/* The free room at the tail of the batch buffer, at most *count events */
+sensors_event_t* NativeSensorManager::batchSpan(struct SoftBatch *batch, int *count)
+{
+	int tail = (batch->head + batch->count) % SOFT_FIFO_EVENTS;
+	int room;
+
+	if (tail >= batch->head)
+		room = SOFT_FIFO_EVENTS - tail;
+	else
+		room = batch->head - tail;
+
+	if (*count > room)
+		*count = room;
+
+	return &batch->buffer[tail];
+}
+
+/* Account for nb events read into the span given by batchSpan() */
+void NativeSensorManager::commitBatch(struct SoftBatch *batch, const sensors_event_t *data,
+		int nb, int64_t latency_ns)
+{
+	int i;
+
+	if (nb <= 0)
+		return;
+
+	/* The latency runs from the oldest sample held */
+	if (batch->count == 0)
+		batch->deadline = getBootTime() + latency_ns;
+
+	/* A flush complete event releases everything queued before it */
+	for (i = 0; i < nb; i++) {
+		if (data[i].type == SENSOR_TYPE_META_DATA)
+			batch->flush = true;
+	}
+
+	batch->count += nb;
+}
+
+int NativeSensorManager::drainBatch(struct SoftBatch *batch, sensors_event_t *data, int count)
+{
+	int number = 0;
+	int n;
+
+	while (count && batch->count) {
+		n = SOFT_FIFO_EVENTS - batch->head;
+		if (n > batch->count)
+			n = batch->count;
+		if (n > count)
+			n = count;
+
+		memcpy(data, &batch->buffer[batch->head], n * sizeof(sensors_event_t));
+		batch->head = (batch->head + n) % SOFT_FIFO_EVENTS;
+		batch->count -= n;
+		data += n;
+		count -= n;
+		number += n;
+	}
+
+	if (batch->count == 0) {
+		batch->head = 0;
+		batch->flush = false;
+	}
+
+	return number;
+}
+
+/* Drop the samples held for a sensor the framework disabled */
+void NativeSensorManager::resetBatch(const struct SensorContext *ctx)
+{
+	struct SoftBatch *batch;
+
+	if (!ctx->soft_fifo)
+		return;
+
+	batch = &batch_list[indexOf(ctx)];
+	delete [] batch->buffer;
+	memset(batch, 0, sizeof(*batch));
+}
+
+/* Milliseconds until the next batch is due, -1 if nothing is held */
+int NativeSensorManager::getBatchTimeout()
+{
+	int64_t now = getBootTime();
+	int64_t wait = -1;
+	int64_t left;
+	int i;
+
+	for (i = 0; i < mSensorCount; i++) {
+		if (!context[i].soft_fifo || (batch_list[i].count == 0) ||
+				(context[i].driver == NULL))
+			continue;
+
+		if (batchDue(&batch_list[i], context[i].latency_ns, now))
+			return 0;
+
+		left = batch_list[i].deadline - now;
+		if ((wait < 0) || (left < wait))
+			wait = left;
+	}
+
+	if (wait < 0)
+		return -1;
+
+	/* Round up so the batch is due when poll returns */
+	return (wait + 999999) / 1000000;
+}
+
+/* Sensors without a hardware FIFO get one emulated by the HAL, so batching
+ * requests still save framework wake ups.
+ */
+void NativeSensorManager::setupSoftBatch(struct SensorContext *ctx)
+{
+	if (ctx->is_virtual || ctx->sensor->fifoMaxEventCount ||
+			(ctx->sensor->flags & SENSOR_FLAG_ONE_SHOT_MODE) || !isContinuous(ctx))
+		return;
+
+	ctx->soft_fifo = true;
+	ctx->sensor->fifoMaxEventCount = SOFT_FIFO_EVENTS;
 }
 
 int NativeSensorManager::batch(int handle, int64_t sample_ns, int64_t latency_ns)
 {
 	SensorContext *list;
-	struct listnode *node;
-	struct SensorRefMap *item;
+	uint64_t mask;
+	int j;
 
 	ALOGD("batch called handle:%d sample_ns:%lld latency_ns:%lld", handle, sample_ns, latency_ns);
 
@@ -1149,14 +2281,12 @@ int NativeSensorManager::batch(int handle, int64_t sample_ns, int64_t latency_ns
 		return 0;
 
 	/* *sample_ns* is the same as *ns* passed to setDelay */
-	list->delay_ns = sample_ns;
-	list->latency_ns = latency_ns;
+	setRequest(list, sample_ns, latency_ns);
 
 	/* should take effect now for ones with listeners */
-	list_for_each(node, &list->dep_list) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		syncDelay(item->ctx->sensor->handle);
-		syncLatency(item->ctx->sensor->handle);
+	for_each_sensor_bit(j, mask, list->dep) {
+		syncDelay(context[j].sensor->handle);
+		syncLatency(context[j].sensor->handle);
 	}
 
 	return 0;
@@ -1166,8 +2296,8 @@ int NativeSensorManager::flush(int handle)
 {
 	const SensorContext *list;
 	int ret = 0;
-	struct SensorRefMap *item;
-	struct listnode *node;
+	uint64_t mask;
+	int j;
 
 	ALOGD("flush called:%d\n", handle);
 	list = getInfoByHandle(handle);
@@ -1180,9 +2310,10 @@ int NativeSensorManager::flush(int handle)
 	if (list->sensor->flags & SENSOR_FLAG_ONE_SHOT_MODE)
 		return -EINVAL;
 
-	list_for_each(node, &list->dep_list) {
-		item = node_to_item(node, struct SensorRefMap, list);
-		ret = item->ctx->driver->flush(item->ctx->sensor->handle);
+	for_each_sensor_bit(j, mask, list->dep) {
+		if (context[j].driver == NULL)
+			return -ENODEV;
+		ret = context[j].driver->flush(context[j].sensor->handle);
 		if (ret) {
 			ALOGE("Calling flush failed(%d)", ret);
 			return ret;
@@ -1191,6 +2322,9 @@ int NativeSensorManager::flush(int handle)
 
 	/* calling flush for virtual sensor */
 	if (list->is_virtual) {
+		/* Not enabled if there is no driver yet */
+		if (list->driver == NULL)
+			return -EINVAL;
 		ret = list->driver->flush(handle);
 		if (ret) {
 			ALOGE("Calling flush failed(%d)", ret);
@@ -1211,6 +2345,12 @@ int NativeSensorManager::hasPendingEvents(int handle)
 		return -EINVAL;
 	}
 
+	if (list->driver == NULL)
+		return 0;
+
+	if (list->soft_fifo && batchDue(&batch_list[indexOf(list)], list->latency_ns, getBootTime()))
+		return 1;
+
 	return list->driver->hasPendingEvents();
 }
 
@@ -1226,6 +2366,8 @@ int NativeSensorManager::calibrate(int handle, struct cal_cmd_t *para)
 		ALOGE("Invalid handle(%d)", handle);
 		return -EINVAL;
 	}
+	if (list->driver == NULL)
+		return -ENODEV;
 	sensor_XML.sensors_rm_file();
 	memset(&cal_result, 0, sizeof(cal_result));
 	err = list->driver->calibrate(handle, para, &cal_result);
@@ -35,12 +35,16 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <utils/Log.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/inotify.h>
 #include <SensorBase.h>
 
 #include <utils/Singleton.h>
-#include <cutils/list.h>
 #include <sensors.h>
 #include <utils/KeyedVector.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
 
 #include "AccelSensor.h"
 #include "LightSensor.h"
@@ -50,21 +54,43 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "PressureSensor.h"
 #include "VirtualSensor.h"
 #include "SignificantMotion.h"
+#include "InputDeviceIndex.h"
+#include "StringArena.h"
 
 #include "sensors_extension.h"
 #include "sensors_XML.h"
 using namespace android;
 
 #define EVENT_PATH "/dev/input/"
+#define DISCOVERY_THREADS	4
+#define DISCOVERY_CACHE_DIR	"/data/misc/sensors"
+#define DISCOVERY_CACHE_PATH	DISCOVERY_CACHE_DIR "/discovery.cache"
+#define HOTPLUG_BUF_SIZE	512
+#define SENSOR_CACHE_LINE	64
+/* Covers the standard sensor types, see SUPPORTED_SENSORS_TYPE */
+#define SENSOR_TYPE_TABLE_SIZE	64
+/* Room left in the sensor tables for sensors probed after discovery */
+#define HOTPLUG_SPARE_SENSORS	4
 #define DEPEND_ON(m, t) (m & (1ULL << t))
 #define SENSORS_HANDLE(x) (SENSORS_HANDLE_BASE + x + 1)
 
-#ifndef list_for_each_safe
-#define list_for_each_safe(node, n, list) \
-	for (node = (list)->next, n = node->next; \
-		node != (list); \
-		node = n, n = node->next)
-#endif
+/* The sensor graph is kept as masks, bit i stands for context[i] */
+#define SENSOR_MASK_BITS	64
+#define SENSOR_BIT(i)		(1ULL << (i))
+/* Distinct rates tracked per sensor. Listeners are bits of the listener
+ * mask, so there can't be more distinct rates than mask bits.
+ */
+#define SENSOR_MAX_LISTENERS	SENSOR_MASK_BITS
+/* Dependencies of a sensor that get their own sample picker */
+#define SENSOR_MAX_DEPS		4
+/* Events decimated for a listener are handed over in chunks of this size */
+#define SENSOR_FANOUT_EVENTS	64
+/* FIFO size advertised for the sensors batched by the HAL */
+#define SOFT_FIFO_EVENTS	256
+
+/* Visit the set bits of m from the lowest one, tmp is the scratch copy */
+#define for_each_sensor_bit(i, tmp, m) \
+	for (tmp = (m); tmp && ((i = __builtin_ctzll(tmp)), 1); tmp &= tmp - 1)
 
 enum {
 	TYPE_STRING = 0,
@@ -73,28 +99,72 @@ enum {
 	TYPE_INTEGER64,
 };
 
-struct SensorContext {
-	char   name[SYSFS_MAXLEN]; // name of the sensor
-	char   vendor[SYSFS_MAXLEN]; // vendor of the sensor
-	char   enable_path[PATH_MAX]; // the control path of this sensor
-	char   data_path[PATH_MAX]; // the data path to get sensor events
+/* The strings of a sensor. They are only used to set the sensor up, so
+ * they are kept out of SensorContext. All of them live in the string arena.
+ */
+struct SensorInfo {
+	const char *name; // name of the sensor
+	const char *vendor; // vendor of the sensor
+	const char *enable_path; // the control path of this sensor
+	const char *data_path; // the data path to get sensor events
+};
 
-	struct sensor_t *sensor; // point to the sensor_t structure in the sensor list
+/* Per sensor state. The fields used for every event fit in the first cache line. */
+struct SensorContext {
 	SensorBase     *driver; // point to the sensor driver instance
-
-	int data_fd; // the file descriptor of the data device node
+	struct sensor_t *sensor; // point to the sensor_t structure in the sensor list
 	int enable; // indicate if the sensor is enabled
-	bool is_virtual; // indicate if this is a virtual sensor
+	int data_fd; // the file descriptor of the data device node
 	int64_t delay_ns; // the poll delay setting of this sensor
 	int64_t latency_ns; // the max report latency of this sensor
-	struct listnode dep_list; // the background sensor type needed for this sensor
+	uint64_t listener; // mask of the sensors listening to this sensor
+	bool is_virtual; // indicate if this is a virtual sensor
+
+	uint64_t dep; // mask of the background sensors needed for this sensor
+	bool soft_fifo; // the FIFO is emulated by the HAL
+	struct SensorInfo *info; // point to the strings in the cold table
+} __attribute__((aligned(SENSOR_CACHE_LINE)));
+
+/* Counted multiset of the values requested by the listeners of a sensor.
+ * Kept sorted, so the minimum is value[0].
+ */
+struct RateSet {
+	int64_t value[SENSOR_MAX_LISTENERS];
+	uint8_t refs[SENSOR_MAX_LISTENERS];
+	int size; // number of distinct values
+};
+
+/* The rates requested from a sensor and the ones written to its driver */
+struct SensorRates {
+	struct RateSet delay; // the non-zero delay_ns of the listeners
+	struct RateSet latency; // the latency_ns of the listeners
+	int64_t programmed_delay; // last delay set on the driver, -1 if unknown
+	int64_t programmed_latency; // last latency set on the driver, -1 if unknown
+};
+
+/* Next sample time wanted by a listener from each of its dependencies. The
+ * slot of a dependency is its rank in the listener's dep mask.
+ */
+struct SensorPicker {
+	int64_t next[SENSOR_MAX_DEPS];
+};
 
-	struct listnode listener; // the head of listeners of this sensor
+/* Samples held back for a sensor batched by the HAL, a ring buffer */
+struct SoftBatch {
+	sensors_event_t *buffer; // SOFT_FIFO_EVENTS events, allocated on first use
+	int head; // the oldest sample
+	int count; // number of samples held
+	int64_t deadline; // when the oldest sample must be released
+	bool flush; // a flush complete event is held
 };
 
-struct SensorEventMap {
-	char data_name[80];
-	char data_path[PATH_MAX];
+/* One node of the virtual sensor graph */
+struct VirtualSensorDesc {
+	int type; // type of the virtual sensor
+	int sensor; // index into virtualSensorList, -1 to copy the input
+	uint64_t inputs; // mask of the hardware types it is built from
+	uint64_t excludes; // not set up if any of these types is present
+	int name; // type of the input naming the chip, -1 to keep the name
 };
 
 struct SysfsMap {
@@ -104,38 +174,94 @@ struct SysfsMap {
 	int required;
 };
 
-/* To contain the listener list and denpend list */
-struct SensorRefMap {
-	struct listnode list;
-	struct SensorContext *ctx;
+/* Scratch record used while loading one sysfs sensor node */
+struct SensorDiscoveryEntry {
+	char node[NAME_MAX + 1]; // the entry name under SYSFS_CLASS
+	struct sensor_t sensor; // attributes loaded from the sysfs node
+	char name[SYSFS_MAXLEN]; // backing store for sensor.name
+	char vendor[SYSFS_MAXLEN]; // backing store for sensor.vendor
+	char data_path[PATH_MAX]; // the input event node of this sensor
+	int err; // result of loading the attributes
+	int event_err; // result of resolving the event node from sysfs
+	bool cached; // restored from the discovery cache
 };
 
 class NativeSensorManager : public Singleton<NativeSensorManager> {
 	friend class Singleton<NativeSensorManager>;
 	NativeSensorManager();
 	~NativeSensorManager();
-	struct sensor_t sensor_list[MAX_SENSORS];
-	struct SensorContext context[MAX_SENSORS];
-	struct SensorEventMap event_list[MAX_SENSORS];
+	struct sensor_t *sensor_list;
+	struct SensorContext *context;
+	struct SensorInfo *info_list;
+	struct SensorRates *rate_list;
+	struct SensorPicker *pick_list;
+	struct SoftBatch *batch_list;
+	sensors_event_t mFanout[SENSOR_FANOUT_EVENTS];
+	StringArena mStrings;
+	int mCapacity;
 	static const struct SysfsMap node_map[];
 	static const struct sensor_t virtualSensorList[];
-	static char virtualSensorName[][SYSFS_MAXLEN];
+	static const struct VirtualSensorDesc virtualSensorGraph[];
 
 	int mSensorCount;
-	bool mScanned;
-	int mEventCount;
+	int64_t mDiscoveryTime;
+	int mDiscoveryThreads;
+	bool mDiscoveryCached;
+	int mHotplugFd;
+	int mEventWd;
+	int mSysfsWd;
+	/* SYSFS_CLASS nodes that failed to load, not probed again until removed */
+	SortedVector<String8> mRejected;
 
-	DefaultKeyedVector<int32_t, struct SensorContext*> type_map;
-	DefaultKeyedVector<int32_t, struct SensorContext*> handle_map;
-	DefaultKeyedVector<int, struct SensorContext*> fd_map;
+	/* Standard types are direct indexed, private ones go to the map */
+	struct SensorContext *type_table[SENSOR_TYPE_TABLE_SIZE];
+	DefaultKeyedVector<int32_t, struct SensorContext*> private_type_map;
+	/* Indexed by the data fd, grown when a larger fd shows up */
+	struct SensorContext **fd_table;
+	int mFdTableSize;
 
+	inline int indexOf(const struct SensorContext *ctx) { return ctx - context; };
+	void setInfoByType(int type, struct SensorContext *ctx);
+	void setInfoByFd(int fd, struct SensorContext *ctx);
 	void compositeVirtualSensorName(const char *sensor_name, char *chip_name, int type);
-	int getNode(char *buf, char *path, const struct SysfsMap *map);
+	int getNode(char *buf, int dirfd, const struct SysfsMap *map);
+	int loadSensorNode(struct SensorDiscoveryEntry *entry);
+	static void* discoveryThread(void *arg);
+	int scanSensorNodes(struct SensorDiscoveryEntry *entries, int max);
+	int commitDiscovery(struct SensorDiscoveryEntry *entries, int count, int base);
+	uint64_t getSysfsFingerprint(int *nodes);
+	int loadDiscoveryCache(struct SensorDiscoveryEntry *entries, int max, uint64_t fingerprint);
+	int saveDiscoveryCache(const struct SensorDiscoveryEntry *entries, int count, uint64_t fingerprint);
 	int getSensorListInner();
+	void allocTables(int capacity);
 	int getDataInfo();
+	int initHardwareSensor(struct SensorContext *list);
+	int attachDriver(struct SensorContext *list);
+	void detachDriver(struct SensorContext *list);
+	int setupHotplug();
+	struct SensorContext* findSensorNode(const char *node);
+	int reattachSensor(struct SensorContext *list);
+	int addHotplugSensor(const char *node);
+	int attachSensorNode(const char *node);
+	int handleSysfsEvent(uint32_t mask, const char *node);
+	int handleInputEvent(uint32_t mask, const char *name);
+	int rescanHotplug();
 	int registerListener(struct SensorContext *hw, struct SensorContext *virt);
 	int unregisterListener(struct SensorContext *hw, struct SensorContext *virt);
 	int syncDelay(int handle);
+	void setRequest(struct SensorContext *ctx, int64_t delay_ns, int64_t latency_ns);
+	void addRequest(struct SensorContext *hw, const struct SensorContext *ctx);
+	void removeRequest(struct SensorContext *hw, const struct SensorContext *ctx);
+	void invalidateRates(const struct SensorContext *ctx);
+	bool isContinuous(const struct SensorContext *ctx);
+	int64_t* getPicker(const struct SensorContext *listener, const struct SensorContext *hw);
+	void setupSoftBatch(struct SensorContext *ctx);
+	struct SoftBatch* getBatch(const struct SensorContext *ctx);
+	bool batchDue(const struct SoftBatch *batch, int64_t latency_ns, int64_t now);
+	sensors_event_t* batchSpan(struct SoftBatch *batch, int *count);
+	void commitBatch(struct SoftBatch *batch, const sensors_event_t *data, int nb, int64_t latency_ns);
+	int drainBatch(struct SoftBatch *batch, sensors_event_t *data, int count);
+	void resetBatch(const struct SensorContext *ctx);
 	int initCalibrate(const SensorContext *list);
 	int initVirtualSensor(struct SensorContext *ctx, int handle, struct sensor_t info);
 	int addDependency(struct SensorContext *ctx, int handle);
@@ -143,10 +269,24 @@ class NativeSensorManager : public Singleton<NativeSensorManager> {
 	int getEventPathOld(const struct SensorContext *list, char *event_path);
 public:
 	int getSensorList(const sensor_t **list);
-	inline SensorContext* getInfoByFd(int fd) { return fd_map.valueFor(fd); };
-	inline SensorContext* getInfoByHandle(int handle) { return handle_map.valueFor(handle); };
-	inline SensorContext* getInfoByType(int type) { return type_map.valueFor(type); };
+	/* Handles are dense, SENSORS_HANDLE(i) is context[i] */
+	inline SensorContext* getInfoByHandle(int handle) {
+		unsigned int i = handle - SENSORS_HANDLE(0);
+		return (i < (unsigned int)mSensorCount) ? &context[i] : NULL;
+	};
+	inline SensorContext* getInfoByFd(int fd) {
+		return ((unsigned int)fd < (unsigned int)mFdTableSize) ? fd_table[fd] : NULL;
+	};
+	inline SensorContext* getInfoByType(int type) {
+		if ((unsigned int)type < SENSOR_TYPE_TABLE_SIZE)
+			return type_table[type];
+		return private_type_map.valueFor(type);
+	};
 	int getSensorCount() {return mSensorCount;}
+	int getCapacity() {return mCapacity;}
+	int getHotplugFd() {return mHotplugFd;}
+	int handleHotplug();
+	int getBatchTimeout();
 	void dump();
 	int hasPendingEvents(int handle);
 	int activate(int handle, int enable);
@@ -118,7 +118,7 @@ ProximitySensor::ProximitySensor(struct SensorContext *context)
         memset(mPendingEvent.data, 0, sizeof(mPendingEvent.data));
 
         data_fd = context->data_fd;
-        strlcpy(input_sysfs_path, context->enable_path, sizeof(input_sysfs_path));
+        strlcpy(input_sysfs_path, context->info->enable_path, sizeof(input_sysfs_path));
         input_sysfs_path_len = strlen(input_sysfs_path);
 }
 
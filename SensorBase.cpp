@@ -29,6 +29,7 @@
 #include <linux/input.h>
 
 #include "NativeSensorManager.h"
+#include "InputDeviceIndex.h"
 #include "SensorBase.h"
 
 /*****************************************************************************/
@@ -38,11 +39,30 @@ SensorBase::SensorBase(
         const char* data_name,
         const struct SensorContext* context /* = NULL */)
         : dev_name(dev_name), data_name(data_name), algo(NULL),
-        dev_fd(-1), data_fd(-1), mEnabled(0), mHasPendingMetadata(0)
+        algo_instance(NULL), dev_fd(-1), data_fd(-1), mEnabled(0), mHasPendingMetadata(0)
 {
         if (context != NULL) {
                 CalibrationManager& cm(CalibrationManager::getInstance());
+                int inputs[SENSOR_MAX_DEPS];
+                int count = 0;
+                uint64_t mask;
+                int i;
+
                 algo = cm.getCalAlgo(context->sensor);
+                if ((algo != NULL) &&
+                                (algo->version >= SENSOR_CAL_ALGO_INSTANCE_VERSION) &&
+                                (algo->methods->create != NULL)) {
+                        for_each_sensor_bit(i, mask, context->dep) {
+                                if (count < SENSOR_MAX_DEPS)
+                                        inputs[count++] = SENSORS_HANDLE(i);
+                        }
+                        algo_instance = algo->methods->create(context->sensor, inputs, count);
+                        if (algo_instance == NULL) {
+                                ALOGE("Create algo instance for %s failed",
+                                                context->sensor->name);
+                                algo = NULL;
+                        }
+                }
 
                 /* Set up the sensors_meta_data_event_t event*/
                 meta_data.version = META_DATA_VERSION;
@@ -60,6 +80,9 @@ SensorBase::SensorBase(
 }
 
 SensorBase::~SensorBase() {
+    if (algo_instance != NULL) {
+        algo->methods->destroy(algo_instance);
+    }
     if (data_fd >= 0) {
         close(data_fd);
     }
@@ -84,6 +107,29 @@ int SensorBase::close_device() {
     return 0;
 }
 
+int SensorBase::algoConvert(sensors_event_t *raw, sensors_event_t *result,
+                struct sensor_algo_args *args)
+{
+        if (algo_instance != NULL)
+                return algo->methods->instance_convert(algo_instance, raw, result, args);
+
+        return algo->methods->convert(raw, result, args);
+}
+
+int SensorBase::algoConfig(int cmd, struct sensor_algo_args *args)
+{
+        if (algo_instance != NULL) {
+                if (algo->methods->instance_config == NULL)
+                        return 0;
+                return algo->methods->instance_config(algo_instance, cmd, args);
+        }
+
+        if (algo->methods->config == NULL)
+                return 0;
+
+        return algo->methods->config(cmd, args);
+}
+
 int SensorBase::getFd() const {
     if (!data_name) {
         return dev_fd;
@@ -108,39 +154,14 @@ int64_t SensorBase::getTimestamp() {
 
 int SensorBase::openInput(const char* inputName) {
     int fd = -1;
-    const char *dirname = "/dev/input";
     char devname[PATH_MAX];
-    char *filename;
-    DIR *dir;
-    struct dirent *de;
-    dir = opendir(dirname);
-    if(dir == NULL)
-        return -1;
-    strlcpy(devname, dirname, PATH_MAX);
-    filename = devname + strlen(devname);
-    *filename++ = '/';
-    while((de = readdir(dir))) {
-        if(de->d_name[0] == '.' &&
-                (de->d_name[1] == '\0' ||
-                        (de->d_name[1] == '.' && de->d_name[2] == '\0')))
-            continue;
-        strlcpy(filename, de->d_name, PATH_MAX - strlen(SYSFS_CLASS));
+    InputDeviceIndex& index(InputDeviceIndex::getInstance());
+
+    if (index.findByName(inputName, devname, sizeof(devname)) == 0) {
         fd = open(devname, O_RDONLY);
-        if (fd>=0) {
-            char name[80];
-            if (ioctl(fd, EVIOCGNAME(sizeof(name) - 1), &name) < 1) {
-                name[0] = '\0';
-            }
-            if (!strcmp(name, inputName)) {
-                strlcpy(input_name, filename, PATH_MAX);
-                break;
-            } else {
-                close(fd);
-                fd = -1;
-            }
-        }
+        if (fd >= 0)
+            strlcpy(input_name, devname + strlen(INPUT_DEVICE_PATH), PATH_MAX);
     }
-    closedir(dir);
     ALOGE_IF(fd<0, "couldn't find '%s' input device", inputName);
     return fd;
 }
@@ -215,7 +236,7 @@ int SensorBase::flush(int32_t handle)
         }
 
         /* sensors have FIFO: call into driver */
-        if (ctx->sensor->fifoMaxEventCount) {
+        if (ctx->sensor->fifoMaxEventCount && !ctx->soft_fifo) {
                 strlcpy(&input_sysfs_path[input_sysfs_path_len],
                                 SYSFS_FLUSH, SYSFS_MAXLEN);
                 fd = open(input_sysfs_path, O_RDWR);
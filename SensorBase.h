@@ -38,6 +38,8 @@ protected:
 	const char*	dev_name;
 	const char*	data_name;
 	const sensor_cal_algo_t*	algo;
+	/* State of this driver's own algo instance, NULL for a legacy algo */
+	void*		algo_instance;
 	char		input_name[PATH_MAX];
 	int		dev_fd;
 	int		data_fd;
@@ -60,6 +62,12 @@ protected:
 	int open_device();
 	int close_device();
 
+	/* Call the algo on algo_instance if there is one */
+	int algoConvert(sensors_event_t *raw, sensors_event_t *result,
+			struct sensor_algo_args *args);
+	/* Return 0 if the algo has no config callback */
+	int algoConfig(int cmd, struct sensor_algo_args *args);
+
 public:
 			SensorBase(const char* dev_name, const char* data_name,
 					const struct SensorContext* context = NULL);
@@ -55,7 +55,7 @@ ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
         mPendingEvent.data[0] = 1.0f;
 
         data_fd = context->data_fd;
-        strlcpy(input_sysfs_path, context->enable_path, sizeof(input_sysfs_path));
+        strlcpy(input_sysfs_path, context->info->enable_path, sizeof(input_sysfs_path));
         input_sysfs_path_len = strlen(input_sysfs_path);
 
         mEnabled = 0;
@@ -0,0 +1,120 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "StringArena.h"
+
+static uint32_t hash_string(const char *s)
+{
+	uint32_t h = 2166136261u;
+
+	while (*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+StringArena::StringArena()
+	: mBlocks(NULL), mBytes(0)
+{
+	memset(mTable, 0, sizeof(mTable));
+}
+
+StringArena::~StringArena()
+{
+	struct Block *block;
+
+	while (mBlocks != NULL) {
+		block = mBlocks;
+		mBlocks = block->next;
+		free(block);
+	}
+}
+
+char* StringArena::alloc(size_t len)
+{
+	struct Block *block = mBlocks;
+	size_t size;
+	char *p;
+
+	if ((block == NULL) || (block->size - block->used < len)) {
+		size = (len > ARENA_BLOCK_SIZE) ? len : ARENA_BLOCK_SIZE;
+		block = (struct Block*)malloc(sizeof(struct Block) + size);
+		if (block == NULL)
+			return NULL;
+
+		block->size = size;
+		block->used = 0;
+		block->next = mBlocks;
+		mBlocks = block;
+		mBytes += sizeof(struct Block) + size;
+	}
+
+	p = block->data + block->used;
+	block->used += len;
+
+	return p;
+}
+
+const char* StringArena::intern(const char *str)
+{
+	uint32_t h = hash_string(str);
+	size_t len = strlen(str) + 1;
+	char *p;
+	int slot = -1;
+	int i;
+
+	/* Linear probing. A full table just stops the sharing. */
+	for (i = 0; i < ARENA_HASH_SIZE; i++) {
+		const char *s = mTable[(h + i) & (ARENA_HASH_SIZE - 1)];
+
+		if (s == NULL) {
+			slot = (h + i) & (ARENA_HASH_SIZE - 1);
+			break;
+		}
+
+		if (strcmp(s, str) == 0)
+			return s;
+	}
+
+	p = alloc(len);
+	if (p == NULL)
+		return "";
+
+	memcpy(p, str, len);
+	if (slot >= 0)
+		mTable[slot] = p;
+
+	return p;
+}
@@ -0,0 +1,64 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_STRING_ARENA_H
+#define SENSOR_STRING_ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE	2048
+/* Power of two. Strings beyond it are still stored, just not shared. */
+#define ARENA_HASH_SIZE		256
+
+/* Append-only storage for the sensor names and paths. Equal strings are
+ * stored once, and a returned pointer stays valid until the arena dies.
+ */
+class StringArena {
+	struct Block {
+		struct Block *next;
+		size_t size;
+		size_t used;
+		char data[];
+	};
+
+	struct Block *mBlocks;
+	const char *mTable[ARENA_HASH_SIZE];
+	size_t mBytes;
+
+	char* alloc(size_t len);
+public:
+	StringArena();
+	~StringArena();
+	/* Return the arena copy of str */
+	const char* intern(const char *str);
+	/* Bytes held by the arena */
+	size_t size() const {return mBytes;}
+};
+
+#endif
@@ -36,28 +36,134 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <float.h>
 #include <sys/select.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
+#include <utils/Atomic.h>
 
 #include "VirtualSensor.h"
+#include "FusionPipeline.h"
 #include "sensors.h"
 
 /*****************************************************************************/
 
+/* sensors.ring.<type> picks what a full output ring does: "drop" drops the
+ * new event, "overwrite" the oldest one and "coalesce" only keeps the latest.
+ * The type is the number as type names overflow PROPERTY_KEY_MAX.
+ * Continuous sensors default to "overwrite", the latest sample matters most.
+ */
+static int ring_policy(const struct sensor_t *sensor)
+{
+	char key[PROPERTY_KEY_MAX];
+	char value[PROPERTY_VALUE_MAX];
+
+	snprintf(key, sizeof(key), "sensors.ring.%d", sensor->type);
+	property_get(key, value, "");
+
+	if (strcmp(value, "drop") == 0)
+		return EVENT_RING_DROP_NEWEST;
+	if (strcmp(value, "overwrite") == 0)
+		return EVENT_RING_OVERWRITE;
+	if (strcmp(value, "coalesce") == 0)
+		return EVENT_RING_COALESCE;
+
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+	if ((sensor->flags & REPORTING_MODE_MASK) == SENSOR_FLAG_CONTINUOUS_MODE)
+		return EVENT_RING_OVERWRITE;
+#endif
+
+	return EVENT_RING_DROP_NEWEST;
+}
+
+/* sensors.ring_size.<type> overrides the capacity of the output ring */
+static int ring_size(const struct sensor_t *sensor)
+{
+	char key[PROPERTY_KEY_MAX];
+	char value[PROPERTY_VALUE_MAX];
+	int size;
+
+	snprintf(key, sizeof(key), "sensors.ring_size.%d", sensor->type);
+	property_get(key, value, "");
+	size = atoi(value);
+
+	return (size > 0) ? size : MAX_EVENTS;
+}
+
+/* sensors.tick.<type>=1 runs the algo of that type once per output period
+ * on the latest input samples. Only for algos that don't need every sample,
+ * such as the orientation, rotation vector and uncalibrated magnetometer
+ * ones of libcalmodule_common.
+ */
+static bool tick_enabled(const struct sensor_t *sensor)
+{
+	char key[PROPERTY_KEY_MAX];
+	char value[PROPERTY_VALUE_MAX];
+
+	snprintf(key, sizeof(key), "sensors.tick.%d", sensor->type);
+	property_get(key, value, "0");
+
+	return atoi(value) != 0;
+}
+
 VirtualSensor::VirtualSensor(const struct SensorContext *ctx)
 	: SensorBase(NULL, NULL, ctx),
 	  reportLastEvent(false),
 	  context(ctx),
-	  mRead(mBuffer),
-	  mWrite(mBuffer),
-	  mBufferEnd(mBuffer + MAX_EVENTS),
-	  mFreeSpace(MAX_EVENTS)
-
+	  mRing(ring_size(ctx->sensor), ring_policy(ctx->sensor)),
+	  mAligner(NULL),
+	  mTick(false),
+	  mNextTick(0),
+	  mPeriodUs(0),
+	  mChanged(0),
+	  mInputCount(0)
 {
+	/* The rate may have been set before the sensor got enabled */
+	setDelay(ctx->sensor->handle, ctx->delay_ns);
+
+#if defined(SENSORS_DEVICE_API_VERSION_1_3)
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	const struct SensorContext *dep;
+	int64_t latency = InputAligner::getLatency();
+	int types[ALIGN_MAX_INPUTS];
+	int count = 0;
+	uint64_t mask;
+	int i;
+
+	/* Only fusion of continuous inputs needs the alignment and the ticks */
+	if ((ctx->sensor->flags & REPORTING_MODE_MASK) != SENSOR_FLAG_CONTINUOUS_MODE)
+		return;
+
+	for_each_sensor_bit(i, mask, ctx->dep) {
+		dep = sm.getInfoByHandle(SENSORS_HANDLE(i));
+		if ((dep == NULL) || (count == ALIGN_MAX_INPUTS) ||
+				((dep->sensor->flags & REPORTING_MODE_MASK) != SENSOR_FLAG_CONTINUOUS_MODE))
+			return;
+		types[count++] = dep->sensor->type;
+	}
+
+	if ((latency > 0) && (count >= 2))
+		mAligner = new InputAligner(types, count, latency);
+
+	if (tick_enabled(ctx->sensor)) {
+		mTick = true;
+		for (i = 0; i < count; i++) {
+			mInputs[i].type = types[i];
+			mInputs[i].timestamp = -1;
+		}
+		mInputCount = count;
+	}
+#endif
 }
 
 VirtualSensor::~VirtualSensor() {
+	FusionPipeline::getInstance().purge(this);
+
+	ALOGI_IF(mRing.getDropped(), "%s dropped %u events\n", context->sensor->name,
+			mRing.getDropped());
+
 	if (mEnabled) {
 		enable(0, 0);
 	}
+
+	delete mAligner;
 }
 
 int VirtualSensor::enable(int32_t, int en) {
@@ -67,8 +173,8 @@ int VirtualSensor::enable(int32_t, int en) {
 	if (mEnabled != flag) {
 		mEnabled = flag;
 		arg.enable = mEnabled;
-		if ((algo != NULL) && (algo->methods->config != NULL)) {
-			if (algo->methods->config(CMD_ENABLE, (sensor_algo_args*)&arg)) {
+		if (algo != NULL) {
+			if (algoConfig(CMD_ENABLE, (sensor_algo_args*)&arg)) {
 				ALOGW("Calling enable config failed");
 			}
 		}
@@ -79,8 +185,22 @@ int VirtualSensor::enable(int32_t, int en) {
 	return 0;
 }
 
+/* Called under the manager lock whenever delay_ns changes. Hand the period
+ * over to the fusion worker through a single word.
+ */
+int VirtualSensor::setDelay(int32_t, int64_t ns)
+{
+	int64_t us = ns / 1000;
+
+	if (us > INT32_MAX)
+		us = INT32_MAX;
+	android_atomic_release_store((int32_t)us, &mPeriodUs);
+
+	return 0;
+}
+
 bool VirtualSensor::hasPendingEvents() const {
-	return (mBufferEnd - mBuffer - mFreeSpace) || reportLastEvent;
+	return !mRing.isEmpty() || reportLastEvent;
 }
 
 int VirtualSensor::readEvents(sensors_event_t* data, int count)
@@ -91,27 +211,16 @@ int VirtualSensor::readEvents(sensors_event_t* data, int count)
 		return -EINVAL;
 
 	if (reportLastEvent) {
-		*data++ = mLastEvent;
-		count--;
+		data[number++] = mLastEvent;
 		reportLastEvent = false;
-		number++;
 	}
 
-	if (mHasPendingMetadata && count) {
-		*data++ = meta_data;
-		count--;
+	if (mHasPendingMetadata && (number < count)) {
+		data[number++] = meta_data;
 		mHasPendingMetadata--;
-		number++;
 	}
 
-	while (count && (mBufferEnd - mBuffer - mFreeSpace)) {
-		*data++ = *mRead++;
-		if (mRead >= mBufferEnd)
-			mRead = mBuffer;
-		number++;
-		mFreeSpace++;
-		count--;
-	}
+	number += mRing.read(data + number, count - number);
 
 	if (number > 0)
 		mLastEvent = data[number - 1];
@@ -119,40 +228,201 @@ int VirtualSensor::readEvents(sensors_event_t* data, int count)
 	return number;
 }
 
+/* Hand the input events to the fusion worker, or convert them right away
+ * if the algos run on the poll thread.
+ */
 int VirtualSensor::injectEvents(sensors_event_t* data, int count)
 {
-	int i;
-	sensors_event_t event;
+	FusionPipeline& pipeline(FusionPipeline::getInstance());
+	int dropped;
 
 	if (algo == NULL)
 		return 0;
 
+	if (!pipeline.isAsync()) {
+		process(data, count);
+		return 0;
+	}
+
+	dropped = pipeline.submit(this, data, count);
+	if (dropped)
+		ALOGW("Fusion queue is full, %d events dropped\n", dropped);
+
+	return 0;
+}
+
+/* Align the input events if needed and run the algo on them.
+ * Return the number of events produced.
+ */
+int VirtualSensor::process(const sensors_event_t* data, int count)
+{
+	const sensors_event_t *aligned;
+	int produced = 0;
+	int i;
+	int n;
+
+	if (mAligner == NULL)
+		return runAlgo(data, count);
+
 	for (i = 0; i < count; i++) {
-		event = data[i];
-		sensors_event_t out;
-		if (mFreeSpace) {
-			if (algo->methods->convert(&event, &out, NULL))
-				continue;
+		n = mAligner->push(&data[i], &aligned);
+		produced += runAlgo(aligned, n);
+	}
 
-			out.version = sizeof(sensors_event_t);
-			out.sensor = context->sensor->handle;
-			out.type = context->sensor->type;
+	return produced;
+}
+
+/* Copy a converted event to the ring. Return false if it was dropped. */
+bool VirtualSensor::publish(const sensors_event_t *result, int64_t timestamp)
+{
+	sensors_event_t *out = mRing.reserve();
+
+	if (out == NULL)
+		return false;
+
+	*out = *result;
+	out->version = sizeof(sensors_event_t);
+	out->sensor = context->sensor->handle;
+	out->type = context->sensor->type;
 #if defined(SENSORS_DEVICE_API_VERSION_1_3)
-			out.flags = context->sensor->flags;
+	out->flags = context->sensor->flags;
 #endif
-			out.timestamp = event.timestamp;
+	out->timestamp = timestamp;
 
-			*mWrite++ = out;
-			mFreeSpace--;
-			if (mWrite >= mBufferEnd) {
-				mWrite = mBuffer;
-			}
+	mRing.commit();
 
-		} else {
-			ALOGW("Circular buffer is full\n");
-		}
+	return true;
+}
+
+/* The slot of mInputs keeping the samples of type, or -1 */
+int VirtualSensor::findInput(int type) const
+{
+	int i;
+
+	for (i = 0; i < mInputCount; i++) {
+		if (mInputs[i].type == type)
+			return i;
 	}
 
-	return 0;
+	return -1;
+}
+
+/* Run the algo on the input events and publish the results to the ring.
+ * Return the number of events produced.
+ */
+int VirtualSensor::runAlgo(const sensors_event_t* data, int count)
+{
+	int i;
+	int j;
+	int produced = 0;
+	int dropped = 0;
+	int64_t period = 0;
+	sensors_event_t event;
+	sensors_event_t result;
+
+	if (mTick)
+		period = (int64_t)android_atomic_acquire_load(&mPeriodUs) * 1000;
+
+	/* Without a rate there is no tick, every sample is converted */
+	if (period > 0)
+		return runTicks(data, count, period);
+
+	/* Never publish stack garbage if an algo reports success without output */
+	memset(&result, 0, sizeof(result));
+
+	for (i = 0; i < count; i++) {
+		/* Keep the latest inputs for when a rate gets set */
+		if (mTick && ((j = findInput(data[i].type)) >= 0))
+			mInputs[j] = data[i];
+
+		/* The algo may scribble on its input, keep the caller's copy intact */
+		event = data[i];
+		if (algoConvert(&event, &result, NULL))
+			continue;
+
+		if (publish(&result, event.timestamp))
+			produced++;
+		else
+			dropped++;
+	}
+	mChanged = 0;
+
+	if (dropped)
+		ALOGW("Circular buffer is full, %d events dropped\n", dropped);
+
+	return produced;
 }
 
+/* Keep the latest sample of each input and only run the algo once per
+ * period on the ones that changed, at the timestamp of the sample that
+ * reached the tick.
+ */
+int VirtualSensor::runTicks(const sensors_event_t* data, int count, int64_t period)
+{
+	int i;
+	int j;
+	int k;
+	int n;
+	int produced = 0;
+	int dropped = 0;
+	bool converted;
+	int64_t ts;
+	sensors_event_t event;
+	sensors_event_t result;
+
+	memset(&result, 0, sizeof(result));
+
+	for (i = 0; i < count; i++) {
+		j = findInput(data[i].type);
+		if (j < 0)
+			continue;
+		mInputs[j] = data[i];
+		mChanged |= 1U << j;
+
+		/* Not due yet, an eighth of the period early is still on time */
+		ts = data[i].timestamp;
+		if (ts + period / 8 < mNextTick)
+			continue;
+		mNextTick = (mNextTick + period > ts) ? mNextTick + period : ts + period;
+
+		/* Apply the inputs that changed since the last tick with their own
+		 * timestamps, the one that reached the tick last so the result
+		 * reflects it.
+		 */
+		converted = false;
+		for (k = 1; k <= mInputCount; k++) {
+			n = (j + k) % mInputCount;
+			if (!(mChanged & (1U << n)))
+				continue;
+			event = mInputs[n];
+			converted = !algoConvert(&event, &result, NULL);
+		}
+		mChanged = 0;
+
+		/* An algo may only produce on some of its inputs, e.g. the
+		 * rotation vector on the magnetometer. If the trigger is not one
+		 * of them, convert one that is. It isn't the last sample applied,
+		 * so the algo recomputes on the updated state.
+		 */
+		for (k = 1; !converted && (k < mInputCount); k++) {
+			n = (j + k) % mInputCount;
+			if (mInputs[n].timestamp < 0)
+				continue;
+			event = mInputs[n];
+			converted = !algoConvert(&event, &result, NULL);
+		}
+
+		if (!converted)
+			continue;
+
+		if (publish(&result, ts))
+			produced++;
+		else
+			dropped++;
+	}
+
+	if (dropped)
+		ALOGW("Circular buffer is full, %d events dropped\n", dropped);
+
+	return produced;
+}
@@ -35,6 +35,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/types.h>
 
 #include "SensorBase.h"
+#include "EventRing.h"
+#include "InputAligner.h"
 #include "InputEventReader.h"
 #include "NativeSensorManager.h"
 
@@ -45,21 +47,36 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 struct input_event;
 
 class VirtualSensor : public SensorBase {
+	friend class FusionPipeline;
 	sensors_event_t mLastEvent;
 	bool reportLastEvent;
 	const SensorContext *context;
-	sensors_event_t mBuffer[MAX_EVENTS];
-	sensors_event_t* mRead;
-	sensors_event_t* mWrite;
-	sensors_event_t* mBufferEnd;
-	ssize_t mFreeSpace;
+	/* Written by the fusion worker, read by the poll thread */
+	EventRing mRing;
+	InputAligner *mAligner;
+	/* Outputs on delay_ns from the latest input samples */
+	bool mTick;
+	int64_t mNextTick;
+	/* delay_ns in us, the worker can't read the 64-bit delay_ns untorn */
+	volatile int32_t mPeriodUs;
+	/* Bits of the mInputs not applied to the algo yet */
+	uint32_t mChanged;
+	int mInputCount;
+	sensors_event_t mInputs[ALIGN_MAX_INPUTS];
+	int process(const sensors_event_t* data, int count);
+	int runAlgo(const sensors_event_t* data, int count);
+	int runTicks(const sensors_event_t* data, int count, int64_t period);
+	int findInput(int type) const;
+	bool publish(const sensors_event_t *result, int64_t timestamp);
 public:
 	VirtualSensor(const struct SensorContext *i);
 	virtual ~VirtualSensor();
 	virtual int readEvents(sensors_event_t* data, int count);
 	virtual bool hasPendingEvents() const;
 	virtual int enable(int32_t handle, int enabled);
+	virtual int setDelay(int32_t handle, int64_t ns);
 	virtual int injectEvents(sensors_event_t* data, int count);
+	uint32_t getDropped() const { return mRing.getDropped(); };
 };
 
 /*****************************************************************************/
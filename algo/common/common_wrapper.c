@@ -28,39 +28,31 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 --------------------------------------------------------------------------*/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <CalibrationModule.h>
 #include <sensors.h>
 
 #define LOG_TAG "sensor_cal.common"
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "compass/AKFS_Device.h"
 #include "compass/AKFS_Decomp.h"
 #include "compass/AKFS_AOC.h"
 #include "compass/AKFS_Math.h"
+#include "compass/AKFS_Sphere.h"
 #include "compass/AKFS_VNorm.h"
+#include "fusion_state.h"
 
-#define SENSOR_CAL_ALGO_VERSION 1
+#define SENSOR_CAL_ALGO_VERSION 2
 #define AKM_MAG_SENSE                   (1.0)
 #define CSPEC_HNAVE_V   8
 #define AKFS_GEOMAG_MAX 70
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof(a[0]))
 
-struct sensor_vec {
-	union {
-		struct {
-			float data[4];
-		};
-		struct {
-			float x;
-			float y;
-			float z;
-		};
-	};
-};
-
 struct sensor_cal_module_t SENSOR_CAL_MODULE_INFO;
 static struct sensor_cal_algo_t algo_list[];
 
@@ -75,14 +67,20 @@ static struct sensor_cal_algo_t algo_list[];
 typedef struct _AKMPRMS{
 
 	/* Variables for Decomp. */
-	AKFVEC                  fva_hdata[AKFS_HDATA_SIZE];
 	uint8vec                i8v_asa;
 
 	/* Variables forAOC. */
 	AKFS_AOC_VAR    s_aocv;
 
+	/* Variables for sphere fit, used instead of AOC when set. */
+	AKFS_SPHERE_VAR s_sphv;
+	int16                   i16_hsphere;
+
 	/* Variables for Magnetometer buffer. */
 	AKFVEC                  fva_hvbuf[AKFS_HDATA_SIZE];
+	AKFS_RING               s_hvbuf;
+	AKFS_AVE                s_have;
+	AKFS_NORM               s_hnorm;
 	AKFVEC                  fv_ho;
 	AKFVEC                  fv_hs;
 	AKFS_PATNO              e_hpat;
@@ -104,52 +102,147 @@ typedef struct _AKMPRMS{
 
 } AKMPRMS;
 
+#define FUSION_MAX_INPUTS	4
+
+/* The accelerometer and magnetometer fusion is shared by the orientation and
+ * rotation vector instances fed from the same inputs. Instances may convert
+ * from different threads, so it is locked. The cores are looked up by their
+ * inputs under g_cores_lock, which also guards refs.
+ */
+struct fusion_core {
+	struct fusion_state state;
+	pthread_mutex_t lock;
+	int refs;
+	int inputs[FUSION_MAX_INPUTS];
+	int count;
+	struct fusion_core *next;
+};
+
+/* An orientation or rotation vector instance */
+struct fusion_instance {
+	struct fusion_core *core;
+	int fast;
+};
+
+/* config runs on the activating thread while convert runs on the fusion
+ * worker, both touch the state under lock.
+ */
+struct pocket_state {
+	pthread_mutex_t lock;
+	float last_pocket;
+	float last_light;
+	float last_proximity;
+};
+
+/* State of the legacy convert and config callbacks. Algo instances have
+ * their own, or a fusion core per input set.
+ */
 static AKMPRMS g_prms;
-static float last_pocket = -1.0f;
-static float last_light = -1.0f;
-static float last_proximity = -1.0f;
+static struct fusion_core g_fusion = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+};
+static pthread_mutex_t g_cores_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct fusion_core *g_cores;
+static int g_orientation_fast;
+static int g_rotation_vector_fast;
+static struct pocket_state g_pocket = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.last_pocket = -1.0f,
+	.last_light = -1.0f,
+	.last_proximity = -1.0f,
+};
 
-static int convert_magnetic(sensors_event_t *raw, sensors_event_t *result,
-		struct sensor_algo_args *args __attribute__((unused)))
+/* sensors.fast_math.<type>=1 runs the algo of that type on fast_math */
+static int fast_math_enabled(int type)
+{
+	char key[PROPERTY_KEY_MAX];
+	char value[PROPERTY_VALUE_MAX];
+
+	snprintf(key, sizeof(key), "sensors.fast_math.%d", type);
+	property_get(key, value, "0");
+
+	return atoi(value) != 0;
+}
+
+static void compass_init(AKMPRMS *prms)
+{
+	char value[PROPERTY_VALUE_MAX];
+
+	/* Clear all data. */
+	memset(prms, 0, sizeof(AKMPRMS));
+
+	/* Sensitivity */
+	prms->fv_hs.u.x = AKM_MAG_SENSE;
+	prms->fv_hs.u.y = AKM_MAG_SENSE;
+	prms->fv_hs.u.z = AKM_MAG_SENSE;
+
+	/* Initialize buffer */
+	AKFS_InitRing(AKFS_HDATA_SIZE, prms->fva_hvbuf, &prms->s_hvbuf);
+	AKFS_InitAve(CSPEC_HNAVE_V, &prms->s_have);
+	AKFS_SetNorm(&prms->fv_ho, &prms->fv_hs, AKM_MAG_SENSE, &prms->s_hnorm);
+	AKFS_InitBuffer(AKFS_ADATA_SIZE, prms->fva_avbuf);
+
+	/* Initialize for AOC */
+	AKFS_InitAOC(&prms->s_aocv);
+
+	/* "sphere" selects the recursive sphere fit for the offset */
+	property_get("sensors.compass.offset", value, "aoc");
+	prms->i16_hsphere = !strcmp(value, "sphere");
+	property_get("sensors.compass.lambda", value, "0");
+	AKFS_InitSphere(&prms->s_sphv, atof(value));
+	ALOGI("compass offset estimator: %s\n", prms->i16_hsphere ? "sphere" : "aoc");
+	/* Initialize magnetic status */
+	prms->i16_hstatus = 0;
+}
+
+static int compass_convert(AKMPRMS *prms, sensors_event_t *raw, sensors_event_t *result)
 {
 	int16 akret;
 	int16 aocret;
 	AKFLOAT radius;
-	AKMPRMS *prms = &g_prms;
-	int i;
-
-	/* Shift out old data from the buffer for better calibration */
-	for (i = AKFS_HDATA_SIZE - 1; i >= 1; i--) {
-		prms->fva_hdata[i] = prms->fva_hdata[i - 1];
-	}
+	AKFVEC hdata;
 
-	prms->fva_hdata[0].u.x = raw->magnetic.x;
-	prms->fva_hdata[0].u.y = raw->magnetic.y;
-	prms->fva_hdata[0].u.z = raw->magnetic.z;
+	hdata.u.x = raw->magnetic.x;
+	hdata.u.y = raw->magnetic.y;
+	hdata.u.z = raw->magnetic.z;
 
 	/* Offset calculation is done in this function */
 	/* hdata[in] : Android coordinate, sensitivity adjusted. */
 	/* ho   [out]: Android coordinate, sensitivity adjusted. */
-	aocret = AKFS_AOC(
-		&prms->s_aocv,
-		prms->fva_hdata,
-		&prms->fv_ho
-	);
+	if (prms->i16_hsphere) {
+		aocret = AKFS_Sphere(
+			&prms->s_sphv,
+			&hdata,
+			&prms->fv_ho
+		);
+	} else {
+		aocret = AKFS_AOC(
+			&prms->s_aocv,
+			&hdata,
+			&prms->fv_ho
+		);
+	}
+
+	/* The reciprocal sensitivity is only recomputed with a new offset */
+	if (aocret == AKFS_SUCCESS) {
+		AKFS_SetNorm(
+			&prms->fv_ho,
+			&prms->fv_hs,
+			AKM_MAG_SENSE,
+			&prms->s_hnorm
+		);
+	}
 
 	/* Subtract offset */
 	/* hdata[in] : Android coordinate, sensitivity adjusted. */
-	/* ho   [in] : Android coordinate, sensitivity adjusted. */
+	/* hnorm[in] : offset and reciprocal sensitivity. */
 	/* hvbuf[out]: Android coordinate, sensitivity adjusted, */
 	/*			   offset subtracted. */
-	akret = AKFS_VbNorm(
-		AKFS_HDATA_SIZE,
-		prms->fva_hdata,
-		1,
-		&prms->fv_ho,
-		&prms->fv_hs,
-		AKM_MAG_SENSE,
-		AKFS_HDATA_SIZE,
-		prms->fva_hvbuf
+	akret = AKFS_VbNormInc(
+		&prms->s_hnorm,
+		&hdata,
+		&prms->s_hvbuf,
+		&prms->s_have
 	);
 	if (akret == AKFS_ERROR) {
 		ALOGE("error here!");
@@ -161,10 +254,8 @@ static int convert_magnetic(sensors_event_t *raw, sensors_event_t *result,
 	/*			   offset subtracted. */
 	/* hvec [out]: Android coordinate, sensitivity adjusted, */
 	/*			   offset subtracted, averaged. */
-	akret = AKFS_VbAve(
-		AKFS_HDATA_SIZE,
-		prms->fva_hvbuf,
-		CSPEC_HNAVE_V,
+	akret = AKFS_VbAveInc(
+		&prms->s_have,
 		&prms->fv_hvec
 	);
 	if (akret == AKFS_ERROR) {
@@ -194,101 +285,46 @@ static int convert_magnetic(sensors_event_t *raw, sensors_event_t *result,
 	return 0;
 }
 
-static int convert_orientation(sensors_event_t *raw, sensors_event_t *result,
-		struct sensor_algo_args *args __attribute__((unused)))
+static int orientation_convert(struct fusion_core *core, int fast, sensors_event_t *raw,
+		sensors_event_t *result)
 {
-	float av;
-	float pitch, roll, azimuth;
+	struct fusion_state *state = &core->state;
 	const float rad2deg = 180 / M_PI;
-
-	static struct sensor_vec mag, acc;
-
-	if (raw->type == SENSOR_TYPE_MAGNETIC_FIELD) {
-		mag.x = raw->magnetic.x;
-		mag.y = raw->magnetic.y;
-		mag.z = raw->magnetic.z;
-	}
-
-	if (raw->type == SENSOR_TYPE_ACCELEROMETER) {
-		acc.x = raw->acceleration.x;
-		acc.y = raw->acceleration.y;
-		acc.z = raw->acceleration.z;
-	}
-
-	av = sqrtf(acc.x*acc.x + acc.y*acc.y + acc.z*acc.z);
-	if (av >= DBL_EPSILON) {
-		pitch = asinf(-acc.y / av);
-		roll = asinf(acc.x / av);
-		result->orientation.pitch = pitch * rad2deg;
-		result->orientation.roll = roll * rad2deg;
-		azimuth = atan2(-(mag.x) * cosf(roll) + mag.z * sinf(roll),
-				mag.x*sinf(pitch)*sinf(roll) + mag.y*cosf(pitch) + mag.z*sinf(pitch)*cosf(roll));
-		result->orientation.azimuth =  azimuth * rad2deg;
+	int ret = -EAGAIN;
+
+	/* Only a magnetometer sample with a usable accelerometer produces */
+	pthread_mutex_lock(&core->lock);
+	if (!fusion_update(state, raw, fast) && (raw->type == SENSOR_TYPE_MAGNETIC_FIELD)) {
+		result->orientation.pitch = state->pitch * rad2deg;
+		result->orientation.roll = state->roll * rad2deg;
+		result->orientation.azimuth = state->azimuth * rad2deg;
 		result->orientation.status = 3;
+		ret = 0;
 	}
+	pthread_mutex_unlock(&core->lock);
 
-	if (raw->type != SENSOR_TYPE_MAGNETIC_FIELD)
-		return -EAGAIN;
-
-	return 0;
-
+	return ret;
 }
 
-static int convert_rotation_vector(sensors_event_t *raw, sensors_event_t *result,
-		struct sensor_algo_args *args __attribute__((unused)))
+static int rotation_vector_convert(struct fusion_core *core, int fast, sensors_event_t *raw,
+		sensors_event_t *result)
 {
-	float av;
-	float pitch, roll, azimuth;
-	int i;
-
-	static struct sensor_vec mag, acc;
-
-	if (raw->type == SENSOR_TYPE_MAGNETIC_FIELD) {
-		mag.x = raw->magnetic.x;
-		mag.y = raw->magnetic.y;
-		mag.z = raw->magnetic.z;
-	}
-
-	if (raw->type == SENSOR_TYPE_ACCELEROMETER) {
-		acc.x = raw->acceleration.x;
-		acc.y = raw->acceleration.y;
-		acc.z = raw->acceleration.z;
-	}
-
-
-	av = sqrtf(acc.x*acc.x + acc.y*acc.y + acc.z*acc.z);
-	pitch = asinf(-acc.y / av);
-	roll = asinf(acc.x / av);
-	azimuth = atan2(-(mag.x) * cosf(roll) + mag.z * sinf(roll),
-			mag.x*sinf(pitch)*sinf(roll) + mag.y*cosf(pitch) + mag.z*sinf(pitch)*cosf(roll));
-
-	float halfAzi = azimuth / 2;
-	float halfPitch = pitch / 2;
-	float halfRoll = -roll / 2;
-
-	float c1 = cosf(halfAzi);
-	float s1 = sinf(halfAzi);
-	float c2 = cosf(halfPitch);
-	float s2 = sinf(halfPitch);
-	float c3 = cosf(halfRoll);
-	float s3 = sinf(halfRoll);
-
-	result->data[0] = c1*c2*c3 - s1*s2*s3;
-	result->data[1] = c1*s2*c3 - s1*c2*s3;
-	result->data[2] = c1*c2*s3 + s1*s2*c3;
-	result->data[3] = s1*c2*c3 + c1*s2*s3;
-
-	if (halfAzi < M_PI / 2) {
-		result->data[1] = -result->data[1];
-		result->data[3] = -result->data[3];
-	} else {
-		result->data[2] = -result->data[2];
+	struct fusion_state *state = &core->state;
+	const float *q;
+	int ret = -1;
+
+	pthread_mutex_lock(&core->lock);
+	if (!fusion_update(state, raw, fast) && (raw->type == SENSOR_TYPE_MAGNETIC_FIELD)) {
+		q = fusion_get_quat(state);
+		result->data[0] = q[0];
+		result->data[1] = q[1];
+		result->data[2] = q[2];
+		result->data[3] = q[3];
+		ret = 0;
 	}
+	pthread_mutex_unlock(&core->lock);
 
-	if (raw->type != SENSOR_TYPE_MAGNETIC_FIELD)
-		return -1;
-
-	return 0;
+	return ret;
 }
 
 static int config_magnetic(int cmd, struct sensor_algo_args *args)
@@ -328,40 +364,40 @@ static int convert_uncalibrated_magnetic(sensors_event_t *raw, sensors_event_t *
 	return -1;
 }
 
-static int convert_pocket(sensors_event_t *raw, sensors_event_t *result,
-		struct sensor_algo_args *args __attribute__((unused)))
+static int pocket_update(struct pocket_state *st, sensors_event_t *raw,
+		sensors_event_t *result)
 {
 	float inside;
 
 	*result = *raw;
 	if (raw->type == SENSOR_TYPE_PROXIMITY) {
-		last_proximity = raw->data[0];
+		st->last_proximity = raw->data[0];
 	} else if (raw->type == SENSOR_TYPE_LIGHT) {
-		last_light = raw->data[0];
+		st->last_light = raw->data[0];
 	} else {
 		ALOGE("type error:%d\n", raw->type);
 		return -1;
 	}
 
-	ALOGD("last_light:%f last_proximity:%f\n", last_light, last_proximity);
+	ALOGD("last_light:%f last_proximity:%f\n", st->last_light, st->last_proximity);
 
-	if (last_proximity < 0.0f) {
-		if (last_light < 0.0f) {
+	if (st->last_proximity < 0.0f) {
+		if (st->last_light < 0.0f) {
 			ALOGE("sensor data error\n");
 			return -1;
-		} else if (last_light > 1000.0f) {
+		} else if (st->last_light > 1000.0f) {
 			inside = 0;
 		} else {
 			inside = 1;
 		}
-	} else if (last_proximity < 5.0f) {
+	} else if (st->last_proximity < 5.0f) {
 		inside = 1;
 	} else {
 		inside = 0;
 	}
 
-	if (last_pocket != inside) {
-		last_pocket = inside;
+	if (st->last_pocket != inside) {
+		st->last_pocket = inside;
 		result->data[0] = inside;
 		return 0;
 	}
@@ -369,7 +405,19 @@ static int convert_pocket(sensors_event_t *raw, sensors_event_t *result,
 	return -1;
 }
 
-static int config_pocket(int cmd, struct sensor_algo_args *args)
+static int pocket_convert(struct pocket_state *st, sensors_event_t *raw,
+		sensors_event_t *result)
+{
+	int ret;
+
+	pthread_mutex_lock(&st->lock);
+	ret = pocket_update(st, raw, result);
+	pthread_mutex_unlock(&st->lock);
+
+	return ret;
+}
+
+static int pocket_config(struct pocket_state *st, int cmd, struct sensor_algo_args *args)
 {
 	struct compass_algo_args *param = (struct compass_algo_args*)args;
 
@@ -377,9 +425,11 @@ static int config_pocket(int cmd, struct sensor_algo_args *args)
 		case CMD_ENABLE:
 			ALOGD("Enable status changed to %d\n", param->common.enable);
 			if (param->common.enable) {
-				last_pocket = -1.0f;
-				last_light = -1.0f;
-				last_proximity = -1.0f;
+				pthread_mutex_lock(&st->lock);
+				st->last_pocket = -1.0f;
+				st->last_light = -1.0f;
+				st->last_proximity = -1.0f;
+				pthread_mutex_unlock(&st->lock);
 			}
 			break;
 	}
@@ -387,27 +437,207 @@ static int config_pocket(int cmd, struct sensor_algo_args *args)
 	return 0;
 }
 
-static int cal_init(const struct sensor_cal_module_t *module __attribute__((unused)))
+/* Legacy callbacks, all the sensors share one state per algo */
+static int convert_magnetic(sensors_event_t *raw, sensors_event_t *result,
+		struct sensor_algo_args *args __attribute__((unused)))
 {
-	AKMPRMS *prms = &g_prms;
+	return compass_convert(&g_prms, raw, result);
+}
 
-	/* Clear all data. */
-	memset(prms, 0, sizeof(AKMPRMS));
+static int convert_orientation(sensors_event_t *raw, sensors_event_t *result,
+		struct sensor_algo_args *args __attribute__((unused)))
+{
+	return orientation_convert(&g_fusion, g_orientation_fast, raw, result);
+}
 
-	/* Sensitivity */
-	prms->fv_hs.u.x = AKM_MAG_SENSE;
-	prms->fv_hs.u.y = AKM_MAG_SENSE;
-	prms->fv_hs.u.z = AKM_MAG_SENSE;
+static int convert_rotation_vector(sensors_event_t *raw, sensors_event_t *result,
+		struct sensor_algo_args *args __attribute__((unused)))
+{
+	return rotation_vector_convert(&g_fusion, g_rotation_vector_fast, raw, result);
+}
 
-	/* Initialize buffer */
-	AKFS_InitBuffer(AKFS_HDATA_SIZE, prms->fva_hdata);
-	AKFS_InitBuffer(AKFS_HDATA_SIZE, prms->fva_hvbuf);
-	AKFS_InitBuffer(AKFS_ADATA_SIZE, prms->fva_avbuf);
+static int convert_pocket(sensors_event_t *raw, sensors_event_t *result,
+		struct sensor_algo_args *args __attribute__((unused)))
+{
+	return pocket_convert(&g_pocket, raw, result);
+}
 
-	/* Initialize for AOC */
-	AKFS_InitAOC(&prms->s_aocv);
-	/* Initialize magnetic status */
-	prms->i16_hstatus = 0;
+static int config_pocket(int cmd, struct sensor_algo_args *args)
+{
+	return pocket_config(&g_pocket, cmd, args);
+}
+
+/* Instance callbacks */
+static void* compass_create(const struct sensor_t *sensor __attribute__((unused)),
+		const int *inputs __attribute__((unused)), int count __attribute__((unused)))
+{
+	AKMPRMS *prms = malloc(sizeof(AKMPRMS));
+
+	if (prms != NULL)
+		compass_init(prms);
+
+	return prms;
+}
+
+static int compass_instance_convert(void *instance, sensors_event_t *raw,
+		sensors_event_t *result, struct sensor_algo_args *args __attribute__((unused)))
+{
+	return compass_convert(instance, raw, result);
+}
+
+static int compass_instance_config(void *instance __attribute__((unused)), int cmd,
+		struct sensor_algo_args *args)
+{
+	return config_magnetic(cmd, args);
+}
+
+/* Return the core fed from inputs with a new reference, creating it if no
+ * other instance uses it. Called with g_cores_lock held.
+ */
+static struct fusion_core* fusion_get_core(const int *inputs, int count)
+{
+	struct fusion_core *core;
+
+	for (core = g_cores; core != NULL; core = core->next) {
+		if ((core->count == count) &&
+				!memcmp(core->inputs, inputs, count * sizeof(int))) {
+			core->refs++;
+			return core;
+		}
+	}
+
+	core = malloc(sizeof(struct fusion_core));
+	if (core == NULL)
+		return NULL;
+
+	fusion_reset(&core->state);
+	pthread_mutex_init(&core->lock, NULL);
+	memcpy(core->inputs, inputs, count * sizeof(int));
+	core->count = count;
+	core->refs = 1;
+	core->next = g_cores;
+	g_cores = core;
+
+	return core;
+}
+
+/* Drop a reference of core, freeing it with the last one. Called with
+ * g_cores_lock held.
+ */
+static void fusion_put_core(struct fusion_core *core)
+{
+	struct fusion_core **pp;
+
+	if (--core->refs)
+		return;
+
+	for (pp = &g_cores; *pp != core; pp = &(*pp)->next)
+		;
+	*pp = core->next;
+
+	pthread_mutex_destroy(&core->lock);
+	free(core);
+}
+
+static void* fusion_create(const struct sensor_t *sensor, const int *inputs, int count)
+{
+	struct fusion_instance *fi;
+
+	if ((count < 0) || (count > FUSION_MAX_INPUTS)) {
+		ALOGE("%s: %d inputs, at most %d supported\n", sensor->name, count,
+				FUSION_MAX_INPUTS);
+		return NULL;
+	}
+
+	fi = malloc(sizeof(struct fusion_instance));
+	if (fi == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&g_cores_lock);
+	fi->core = fusion_get_core(inputs, count);
+	pthread_mutex_unlock(&g_cores_lock);
+
+	if (fi->core == NULL) {
+		free(fi);
+		return NULL;
+	}
+
+	fi->fast = fast_math_enabled(sensor->type);
+
+	return fi;
+}
+
+static void fusion_destroy(void *instance)
+{
+	struct fusion_instance *fi = instance;
+
+	pthread_mutex_lock(&g_cores_lock);
+	fusion_put_core(fi->core);
+	pthread_mutex_unlock(&g_cores_lock);
+
+	free(fi);
+}
+
+static int orientation_instance_convert(void *instance, sensors_event_t *raw,
+		sensors_event_t *result, struct sensor_algo_args *args __attribute__((unused)))
+{
+	struct fusion_instance *fi = instance;
+
+	return orientation_convert(fi->core, fi->fast, raw, result);
+}
+
+static int rotation_vector_instance_convert(void *instance, sensors_event_t *raw,
+		sensors_event_t *result, struct sensor_algo_args *args __attribute__((unused)))
+{
+	struct fusion_instance *fi = instance;
+
+	return rotation_vector_convert(fi->core, fi->fast, raw, result);
+}
+
+static void* pocket_create(const struct sensor_t *sensor __attribute__((unused)),
+		const int *inputs __attribute__((unused)), int count __attribute__((unused)))
+{
+	struct pocket_state *st = malloc(sizeof(struct pocket_state));
+
+	if (st != NULL) {
+		pthread_mutex_init(&st->lock, NULL);
+		st->last_pocket = -1.0f;
+		st->last_light = -1.0f;
+		st->last_proximity = -1.0f;
+	}
+
+	return st;
+}
+
+static void pocket_destroy(void *instance)
+{
+	struct pocket_state *st = instance;
+
+	pthread_mutex_destroy(&st->lock);
+	free(st);
+}
+
+static int pocket_instance_convert(void *instance, sensors_event_t *raw,
+		sensors_event_t *result, struct sensor_algo_args *args __attribute__((unused)))
+{
+	return pocket_convert(instance, raw, result);
+}
+
+static int pocket_instance_config(void *instance, int cmd, struct sensor_algo_args *args)
+{
+	return pocket_config(instance, cmd, args);
+}
+
+static int cal_init(const struct sensor_cal_module_t *module __attribute__((unused)))
+{
+	compass_init(&g_prms);
+
+	pthread_mutex_lock(&g_fusion.lock);
+	fusion_reset(&g_fusion.state);
+	pthread_mutex_unlock(&g_fusion.lock);
+
+	g_orientation_fast = fast_math_enabled(SENSOR_TYPE_ORIENTATION);
+	g_rotation_vector_fast = fast_math_enabled(SENSOR_TYPE_ROTATION_VECTOR);
 
 	return 0;
 }
@@ -426,6 +656,10 @@ static int cal_get_algo_list(const struct sensor_cal_algo_t **algo)
 static struct sensor_algo_methods_t compass_methods = {
 	.convert = convert_magnetic,
 	.config = config_magnetic,
+	.create = compass_create,
+	.destroy = free,
+	.instance_convert = compass_instance_convert,
+	.instance_config = compass_instance_config,
 };
 
 static const char* compass_match_table[] = {
@@ -436,6 +670,10 @@ static const char* compass_match_table[] = {
 static struct sensor_algo_methods_t orientation_methods = {
 	.convert = convert_orientation,
 	.config = NULL,
+	.create = fusion_create,
+	.destroy = fusion_destroy,
+	.instance_convert = orientation_instance_convert,
+	.instance_config = NULL,
 };
 
 static const char* orientation_match_table[] = {
@@ -446,6 +684,10 @@ static const char* orientation_match_table[] = {
 static struct sensor_algo_methods_t rotation_vector_methods = {
 	.convert = convert_rotation_vector,
 	.config = NULL,
+	.create = fusion_create,
+	.destroy = fusion_destroy,
+	.instance_convert = rotation_vector_instance_convert,
+	.instance_config = NULL,
 };
 
 static const char* rotation_vector_match_table[] = {
@@ -456,6 +698,7 @@ static const char* rotation_vector_match_table[] = {
 static struct sensor_algo_methods_t mag_uncalib_methods = {
 	.convert = convert_uncalibrated_magnetic,
 	.config = NULL,
+	.create = NULL,
 };
 
 static const char* mag_uncalib_match_table[] = {
@@ -466,6 +709,10 @@ static const char* mag_uncalib_match_table[] = {
 static struct sensor_algo_methods_t pocket_methods = {
 	.convert = convert_pocket,
 	.config = config_pocket,
+	.create = pocket_create,
+	.destroy = pocket_destroy,
+	.instance_convert = pocket_instance_convert,
+	.instance_config = pocket_instance_config,
 };
 
 static const char* pocket_match_table[] = {
@@ -17,6 +17,7 @@
  ******************************************************************************/
 #include "AKFS_AOC.h"
 #include "AKFS_Math.h"
+#include "AKFS_Soa.h"
 
 /*
  * CalcR
@@ -121,90 +122,93 @@ static void MeanVar(
 			AKFVEC	*mean,	/*!< (o)   : (max+min)/2 */
 			AKFVEC	*var	/*!< (o)   : variation in vectors */
 ){
-	int16	i;
 	int16	j;
 	AKFVEC	max;
 	AKFVEC	min;
+	AKFS_RING	ring;
+	AKFS_SOA	sv;
+
+	AKFS_RingView(n, v, &ring);
+	AKFS_SoaLoad(&ring, n, &sv);
+	AKFS_SoaMinMax(&sv, &min, &max);
 
 	for (j = 0; j < 3; j++) {
-		min.v[j] = v[0].v[j];
-		max.v[j] = v[0].v[j];
-		for (i = 1; i < n; i++) {
-			if (v[i].v[j] < min.v[j]) {
-				min.v[j] = v[i].v[j];
-			}
-			if (v[i].v[j] > max.v[j]) {
-				max.v[j] = v[i].v[j];
-			}
-		}
 		mean->v[j] = (max.v[j] + min.v[j]) / 2.0;	/*mean */
 		var->v[j] = max.v[j] - min.v[j];			/*var  */
 	}
 }
 
+/*
+ * ArgMax
+ */
+static int16 ArgMax(
+	const	AKFLOAT	d[],	/*!< (i)   : values */
+	const	int16	n,		/*!< (i)   : number of values */
+	const	int16	absolute	/*!< (i)   : compare absolute values */
+){
+	int16	i;
+	int16	k;
+	AKFLOAT	temp;
+	AKFLOAT	max;
+
+	/* index 0 is the reference point, like 0.0 in the original search */
+	k = 0;
+	max = 0.0;
+	for (i = 1; i < n; i++) {
+		temp = absolute ? fabs(d[i]) : d[i];
+		if (max < temp) {
+			max = temp;
+			k = i;
+		}
+	}
+
+	return k;
+}
+
 /*
  * Get4points
  */
 static void Get4points(
-	const	AKFVEC	v[],	/*!< (i)   : input vectors */
+	const	AKFS_RING	*v,	/*!< (i)   : input vectors */
 	const	int16	n,		/*!< (i)   : number of vectors */
 			AKFVEC	out[]	/*!< (o)   : */
 ){
+	static const AKFVEC	one = {{1, 1, 1}};
+	static const AKFVEC	zero = {{0, 0, 0}};
+	AKFVEC	dv0;
+	AKFVEC	cross;
+	AKFLOAT	d[AKFS_HBUF_SIZE];
 	int16	i, j;
-	AKFLOAT temp;
-	AKFLOAT d;
 
-	AKFVEC	dv[AKFS_HBUF_SIZE];
-	AKFVEC	cross = {{0, 0, 0}};
-	AKFVEC	tempv = {{0, 0, 0}};
+	AKFS_SOA	sv;
+	AKFS_SOA	dv;
+	AKFS_SOA	cv;
+
+	AKFS_SoaLoad(v, n, &sv);
 
 	/* out 0 */
-	out[0] = v[0];
+	out[0] = *AKFS_RingAt(v, 0);
 
-	/* out 1 */
-	d = 0.0;
-	for (i = 1; i < n; i++) {
-		temp = CalcR(&v[i], &out[0]);
-		if (d < temp) {
-			d = temp;
-			out[1] = v[i];
-		}
-	}
+	/* out 1, farthest from out 0 */
+	AKFS_SoaDist2(&sv, &out[0], d);
+	out[1] = *AKFS_RingAt(v, ArgMax(d, n, 0));
 
-	/* out 2 */
-	d = 0.0;
+	/* out 2, largest triangle with out 0 and out 1 */
 	for (j = 0; j < 3; j++) {
-		dv[0].v[j] = out[1].v[j] - out[0].v[j];
-	}
-	for (i = 1; i < n; i++) {
-		for (j = 0; j < 3; j++) {
-			dv[i].v[j] = v[i].v[j] - out[0].v[j];
-		}
-		tempv.v[0] = dv[0].v[1]*dv[i].v[2] - dv[0].v[2]*dv[i].v[1];
-		tempv.v[1] = dv[0].v[2]*dv[i].v[0] - dv[0].v[0]*dv[i].v[2];
-		tempv.v[2] = dv[0].v[0]*dv[i].v[1] - dv[0].v[1]*dv[i].v[0];
-		temp =	tempv.u.x * tempv.u.x
-			  +	tempv.u.y * tempv.u.y
-			  +	tempv.u.z * tempv.u.z;
-		if (d < temp) {
-			d = temp;
-			out[2] = v[i];
-			cross = tempv;
-		}
-	}
-
-	/* out 3 */
-	d = 0.0;
-	for (i = 1; i < n; i++) {
-		temp =	  dv[i].u.x * cross.u.x
-				+ dv[i].u.y * cross.u.y
-				+ dv[i].u.z * cross.u.z;
-		temp = fabs(temp);
-		if (d < temp) {
-			d = temp;
-			out[3] = v[i];
-		}
+		dv0.v[j] = out[1].v[j] - out[0].v[j];
 	}
+	AKFS_SoaNorm(&sv, &out[0], &one, &dv);
+	AKFS_SoaCross(&dv0, &dv, &cv);
+	AKFS_SoaDist2(&cv, &zero, d);
+	i = ArgMax(d, n, 0);
+	out[2] = *AKFS_RingAt(v, i);
+	cross.u.x = (i == 0) ? 0 : cv.x[i];
+	cross.u.y = (i == 0) ? 0 : cv.y[i];
+	cross.u.z = (i == 0) ? 0 : cv.z[i];
+
+	/* out 3, farthest from the plane of the others */
+	AKFS_SoaDot(&dv, &cross, d);
+	out[3] = *AKFS_RingAt(v, ArgMax(d, n, 1));
 }
 
 /*
@@ -243,15 +247,12 @@ int16 AKFS_AOC(				/*!< (o) : calibration success(AKFS_SUCCESS), failure(AKFS_ER
 	AKFVEC	mean;
 
 	/* buffer new data */
-	for (i = 1; i < AKFS_HBUF_SIZE; i++) {
-		haocv->hbuf[AKFS_HBUF_SIZE-i] = haocv->hbuf[AKFS_HBUF_SIZE-i-1];
-	}
-	haocv->hbuf[0] = *hdata;
+	AKFS_RingPush(hdata, &haocv->hring);
 
 	/* Check Init */
 	num = 0;
 	for (i = AKFS_HBUF_SIZE; 3 < i; i--) {
-		if (CheckInitFvec(&haocv->hbuf[i-1]) == 0) {
+		if (CheckInitFvec(AKFS_RingAt(&haocv->hring, i-1)) == 0) {
 			num = i;
 			break;
 		}
@@ -261,7 +262,7 @@ int16 AKFS_AOC(				/*!< (o) : calibration success(AKFS_SUCCESS), failure(AKFS_ER
 	}
 
 	/* get 4 points */
-	Get4points(haocv->hbuf, num, fourpoints);
+	Get4points(&haocv->hring, num, fourpoints);
 
 	/* estimate offset */
 	if (0 != From4Points2Sphere(fourpoints, &tempho, &haocv->hraoc)) {
@@ -287,7 +288,7 @@ int16 AKFS_AOC(				/*!< (o) : calibration success(AKFS_SUCCESS), failure(AKFS_ER
 	/* clear hbuf */
 	for (i = (AKFS_HBUF_SIZE>>1); i < AKFS_HBUF_SIZE; i++) {
 		for (j = 0; j < 3; j++) {
-			haocv->hbuf[i].v[j] = AKFS_FMAX;
+			AKFS_RingAt(&haocv->hring, i)->v[j] = AKFS_FMAX;
 		}
 	}
 
@@ -317,11 +318,7 @@ void AKFS_InitAOC(
 	int16 i, j;
 
 	/* Initialize buffer */
-	for (i = 0; i < AKFS_HBUF_SIZE; i++) {
-		for (j = 0; j < 3; j++) {
-			haocv->hbuf[i].v[j] = AKFS_FMAX;
-		}
-	}
+	AKFS_InitRing(AKFS_HBUF_SIZE, haocv->hbuf, &haocv->hring);
 	for (i = 0; i < AKFS_HOBUF_SIZE; i++) {
 		for (j = 0; j < 3; j++) {
 			haocv->hobuf[i].v[j] = AKFS_FMAX;
@@ -31,6 +31,7 @@
 /***** Type declaration *******************************************************/
 typedef struct _AKFS_AOC_VAR{
 	AKFVEC		hbuf[AKFS_HBUF_SIZE];
+	AKFS_RING	hring;	/* newest first view of hbuf */
 	AKFVEC		hobuf[AKFS_HOBUF_SIZE];
 	AKFLOAT		hraoc;
 } AKFS_AOC_VAR;
@@ -44,6 +44,57 @@ int16 AKFS_InitBuffer(
 	return AKFS_SUCCESS;
 }
 
+/******************************************************************************/
+/*! Initialize #AKFS_RING over a buffer and fill it with initial values.
+  @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
+  @param[in] size
+  @param[in] buf
+  @param[out] ring
+ */
+int16 AKFS_InitRing(
+	const	int16		size,	/*!< Size of vector buffer */
+			AKFVEC		buf[],	/*!< Vector buffer */
+			AKFS_RING	*ring	/*!< Ring over buf */
+)
+{
+	ring->buf = buf;
+	ring->size = size;
+	ring->head = 0;
+
+	return AKFS_InitBuffer(size, buf);
+}
+
+/******************************************************************************/
+/*! Look at an #AKFVEC array, newest first, as a #AKFS_RING.
+  @param[in] size
+  @param[in] buf
+  @param[out] ring
+ */
+void AKFS_RingView(
+	const	int16		size,	/*!< Size of vector buffer */
+	const	AKFVEC		buf[],	/*!< Vector buffer */
+			AKFS_RING	*ring	/*!< Ring over buf */
+)
+{
+	ring->buf = (AKFVEC *)buf;
+	ring->size = size;
+	ring->head = 0;
+}
+
+/******************************************************************************/
+/*! Push a vector to #AKFS_RING, dropping the oldest one.
+  @param[in] v
+  @param[in/out] ring
+ */
+void AKFS_RingPush(
+	const	AKFVEC		*v,		/*!< New vector */
+			AKFS_RING	*ring	/*!< Ring */
+)
+{
+	ring->head = (ring->head > 0) ? (ring->head - 1) : (ring->size - 1);
+	ring->buf[ring->head] = *v;
+}
+
 /******************************************************************************/
 /*! Shift #AKFVEC array.
   @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
@@ -71,6 +71,29 @@ typedef union _AKFVEC {
 	AKFLOAT	v[3];
 } AKFVEC;
 
+/***** Ring buffer ***********************************************************/
+/* History of vectors, the newest first. Pushing moves the head instead of
+ * shifting the whole buffer. A plain array is a ring with its head at 0. */
+typedef struct _AKFS_RING {
+	AKFVEC	*buf;
+	int16	size;
+	int16	head;	/* index of the newest vector in buf */
+} AKFS_RING;
+
+/* The i-th newest vector, 0 <= i < size */
+static inline AKFVEC* AKFS_RingAt(
+	const	AKFS_RING	*ring,
+	const	int16		i
+)
+{
+	int16 n = ring->head + i;
+
+	if (n >= ring->size) {
+		n -= ring->size;
+	}
+	return &ring->buf[n];
+}
+
 /***** Layout pattern ********************************************************/
 typedef enum _AKFS_PATNO {
 	PAT_INVALID = 0,
@@ -91,6 +114,23 @@ int16 AKFS_InitBuffer(
 			AKFVEC	vdata[]		/*!< Raw vector buffer */
 );
 
+int16 AKFS_InitRing(
+	const	int16		size,
+			AKFVEC		buf[],
+			AKFS_RING	*ring
+);
+
+void AKFS_RingView(
+	const	int16		size,
+	const	AKFVEC		buf[],
+			AKFS_RING	*ring
+);
+
+void AKFS_RingPush(
+	const	AKFVEC		*v,
+			AKFS_RING	*ring
+);
+
 int16 AKFS_BufShift(
 	const	int16	len,
 	const	int16	shift,
@@ -123,6 +123,7 @@ int16 AKFS_Direction(
 )
 {
 	AKFVEC have, aave;
+	AKFS_RING hring, aring;
 	AKFLOAT azimuthRad;
 	AKFLOAT pitchRad;
 	AKFLOAT rollRad;
@@ -136,10 +137,12 @@ int16 AKFS_Direction(
 	}
 
 	/* average */
-	if (AKFS_VbAve(nhvec, hvec, hnave, &have) != AKFS_SUCCESS) {
+	AKFS_RingView(nhvec, hvec, &hring);
+	AKFS_RingView(navec, avec, &aring);
+	if (AKFS_VbAve(&hring, hnave, &have) != AKFS_SUCCESS) {
 		return AKFS_ERROR;
 	}
-	if (AKFS_VbAve(navec, avec, anave, &aave) != AKFS_SUCCESS) {
+	if (AKFS_VbAve(&aring, anave, &aave) != AKFS_SUCCESS) {
 		return AKFS_ERROR;
 	}
 
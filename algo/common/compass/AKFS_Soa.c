@@ -0,0 +1,307 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2012 Asahi Kasei Microdevices Corporation, Japan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+#include "AKFS_Soa.h"
+
+#if !defined(AKFS_PRECISION_DOUBLE) && !defined(AKFS_SOA_NO_SIMD)
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+typedef float32x4_t	AKFV4;
+#define V4_LOAD(p)		vld1q_f32(p)
+#define V4_STORE(p, a)	vst1q_f32((p), (a))
+#define V4_SET(f)		vdupq_n_f32(f)
+#define V4_ADD(a, b)	vaddq_f32((a), (b))
+#define V4_SUB(a, b)	vsubq_f32((a), (b))
+#define V4_MUL(a, b)	vmulq_f32((a), (b))
+#define V4_MIN(a, b)	vminq_f32((a), (b))
+#define V4_MAX(a, b)	vmaxq_f32((a), (b))
+#define AKFS_SOA_V4
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+typedef __m128		AKFV4;
+#define V4_LOAD(p)		_mm_loadu_ps(p)
+#define V4_STORE(p, a)	_mm_storeu_ps((p), (a))
+#define V4_SET(f)		_mm_set1_ps(f)
+#define V4_ADD(a, b)	_mm_add_ps((a), (b))
+#define V4_SUB(a, b)	_mm_sub_ps((a), (b))
+#define V4_MUL(a, b)	_mm_mul_ps((a), (b))
+#define V4_MIN(a, b)	_mm_min_ps((a), (b))
+#define V4_MAX(a, b)	_mm_max_ps((a), (b))
+#define AKFS_SOA_V4
+#endif
+#endif
+
+#ifdef AKFS_SOA_V4
+/*
+ * ReduceMin
+ */
+static AKFLOAT ReduceMin(
+	const	AKFV4	a
+){
+	AKFLOAT	lane[4];
+	AKFLOAT	r;
+	int16	j;
+
+	V4_STORE(lane, a);
+	r = lane[0];
+	for (j = 1; j < 4; j++) {
+		if (lane[j] < r) {
+			r = lane[j];
+		}
+	}
+	return r;
+}
+
+/*
+ * ReduceMax
+ */
+static AKFLOAT ReduceMax(
+	const	AKFV4	a
+){
+	AKFLOAT	lane[4];
+	AKFLOAT	r;
+	int16	j;
+
+	V4_STORE(lane, a);
+	r = lane[0];
+	for (j = 1; j < 4; j++) {
+		if (lane[j] > r) {
+			r = lane[j];
+		}
+	}
+	return r;
+}
+#endif
+
+/******************************************************************************/
+/*! Transpose the newest n vectors of a ring into a #AKFS_SOA.
+  @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
+  @param[in] ring
+  @param[in] n Number of vectors
+  @param[out] soa
+ */
+int16 AKFS_SoaLoad(
+	const	AKFS_RING	*ring,
+	const	int16		n,
+			AKFS_SOA	*soa
+){
+	int16 i;
+	const AKFVEC *v;
+
+	if ((n < 0) || (n > AKFS_SOA_SIZE) || (n > ring->size)) {
+		return AKFS_ERROR;
+	}
+
+	for (i = 0; i < n; i++) {
+		v = AKFS_RingAt(ring, i);
+		soa->x[i] = v->u.x;
+		soa->y[i] = v->u.y;
+		soa->z[i] = v->u.z;
+	}
+	soa->n = n;
+
+	return AKFS_SUCCESS;
+}
+
+/******************************************************************************/
+/*! out = (in - o) * k for every vector. in and out may be the same.
+  @param[in] in
+  @param[in] o Offset
+  @param[in] k Reciprocal sensitivity
+  @param[out] out
+ */
+void AKFS_SoaNorm(
+	const	AKFS_SOA	*in,
+	const	AKFVEC		*o,
+	const	AKFVEC		*k,
+			AKFS_SOA	*out
+){
+	int16 i = 0;
+#ifdef AKFS_SOA_V4
+	AKFV4 ox = V4_SET(o->u.x), oy = V4_SET(o->u.y), oz = V4_SET(o->u.z);
+	AKFV4 kx = V4_SET(k->u.x), ky = V4_SET(k->u.y), kz = V4_SET(k->u.z);
+
+	for (; i + 4 <= in->n; i += 4) {
+		V4_STORE(&out->x[i], V4_MUL(V4_SUB(V4_LOAD(&in->x[i]), ox), kx));
+		V4_STORE(&out->y[i], V4_MUL(V4_SUB(V4_LOAD(&in->y[i]), oy), ky));
+		V4_STORE(&out->z[i], V4_MUL(V4_SUB(V4_LOAD(&in->z[i]), oz), kz));
+	}
+#endif
+	for (; i < in->n; i++) {
+		out->x[i] = (in->x[i] - o->u.x) * k->u.x;
+		out->y[i] = (in->y[i] - o->u.y) * k->u.y;
+		out->z[i] = (in->z[i] - o->u.z) * k->u.z;
+	}
+	out->n = in->n;
+}
+
+/******************************************************************************/
+/*! Per axis minimum and maximum. soa must not be empty.
+  @param[in] soa
+  @param[out] min
+  @param[out] max
+ */
+void AKFS_SoaMinMax(
+	const	AKFS_SOA	*soa,
+			AKFVEC		*min,
+			AKFVEC		*max
+){
+	int16 i = 0;
+#ifdef AKFS_SOA_V4
+	if (soa->n >= 4) {
+		AKFV4 nx = V4_LOAD(&soa->x[0]), xx = nx;
+		AKFV4 ny = V4_LOAD(&soa->y[0]), xy = ny;
+		AKFV4 nz = V4_LOAD(&soa->z[0]), xz = nz;
+
+		for (i = 4; i + 4 <= soa->n; i += 4) {
+			AKFV4 vx = V4_LOAD(&soa->x[i]);
+			AKFV4 vy = V4_LOAD(&soa->y[i]);
+			AKFV4 vz = V4_LOAD(&soa->z[i]);
+			nx = V4_MIN(nx, vx);
+			xx = V4_MAX(xx, vx);
+			ny = V4_MIN(ny, vy);
+			xy = V4_MAX(xy, vy);
+			nz = V4_MIN(nz, vz);
+			xz = V4_MAX(xz, vz);
+		}
+
+		min->u.x = ReduceMin(nx);
+		max->u.x = ReduceMax(xx);
+		min->u.y = ReduceMin(ny);
+		max->u.y = ReduceMax(xy);
+		min->u.z = ReduceMin(nz);
+		max->u.z = ReduceMax(xz);
+	}
+#endif
+	if (i == 0) {
+		min->u.x = max->u.x = soa->x[0];
+		min->u.y = max->u.y = soa->y[0];
+		min->u.z = max->u.z = soa->z[0];
+		i = 1;
+	}
+	for (; i < soa->n; i++) {
+		if (soa->x[i] < min->u.x) {
+			min->u.x = soa->x[i];
+		}
+		if (soa->x[i] > max->u.x) {
+			max->u.x = soa->x[i];
+		}
+		if (soa->y[i] < min->u.y) {
+			min->u.y = soa->y[i];
+		}
+		if (soa->y[i] > max->u.y) {
+			max->u.y = soa->y[i];
+		}
+		if (soa->z[i] < min->u.z) {
+			min->u.z = soa->z[i];
+		}
+		if (soa->z[i] > max->u.z) {
+			max->u.z = soa->z[i];
+		}
+	}
+}
+
+/******************************************************************************/
+/*! Squared distance of every vector from p, dx*dx + dy*dy + dz*dz.
+  @param[in] soa
+  @param[in] p
+  @param[out] d soa->n distances
+ */
+void AKFS_SoaDist2(
+	const	AKFS_SOA	*soa,
+	const	AKFVEC		*p,
+			AKFLOAT		d[]
+){
+	int16 i = 0;
+	AKFLOAT dx, dy, dz;
+#ifdef AKFS_SOA_V4
+	AKFV4 px = V4_SET(p->u.x), py = V4_SET(p->u.y), pz = V4_SET(p->u.z);
+
+	for (; i + 4 <= soa->n; i += 4) {
+		AKFV4 vx = V4_SUB(V4_LOAD(&soa->x[i]), px);
+		AKFV4 vy = V4_SUB(V4_LOAD(&soa->y[i]), py);
+		AKFV4 vz = V4_SUB(V4_LOAD(&soa->z[i]), pz);
+		V4_STORE(&d[i], V4_ADD(V4_ADD(V4_MUL(vx, vx), V4_MUL(vy, vy)),
+					V4_MUL(vz, vz)));
+	}
+#endif
+	for (; i < soa->n; i++) {
+		dx = soa->x[i] - p->u.x;
+		dy = soa->y[i] - p->u.y;
+		dz = soa->z[i] - p->u.z;
+		d[i] = dx * dx + dy * dy + dz * dz;
+	}
+}
+
+/******************************************************************************/
+/*! Dot product of every vector with a, x*a.x + y*a.y + z*a.z.
+  @param[in] soa
+  @param[in] a
+  @param[out] d soa->n products
+ */
+void AKFS_SoaDot(
+	const	AKFS_SOA	*soa,
+	const	AKFVEC		*a,
+			AKFLOAT		d[]
+){
+	int16 i = 0;
+#ifdef AKFS_SOA_V4
+	AKFV4 ax = V4_SET(a->u.x), ay = V4_SET(a->u.y), az = V4_SET(a->u.z);
+
+	for (; i + 4 <= soa->n; i += 4) {
+		V4_STORE(&d[i], V4_ADD(V4_ADD(
+					V4_MUL(V4_LOAD(&soa->x[i]), ax),
+					V4_MUL(V4_LOAD(&soa->y[i]), ay)),
+					V4_MUL(V4_LOAD(&soa->z[i]), az)));
+	}
+#endif
+	for (; i < soa->n; i++) {
+		d[i] = soa->x[i] * a->u.x + soa->y[i] * a->u.y + soa->z[i] * a->u.z;
+	}
+}
+
+/******************************************************************************/
+/*! Cross product a x v of a with every vector. in and out must differ.
+  @param[in] a
+  @param[in] in
+  @param[out] out
+ */
+void AKFS_SoaCross(
+	const	AKFVEC		*a,
+	const	AKFS_SOA	*in,
+			AKFS_SOA	*out
+){
+	int16 i = 0;
+#ifdef AKFS_SOA_V4
+	AKFV4 ax = V4_SET(a->u.x), ay = V4_SET(a->u.y), az = V4_SET(a->u.z);
+
+	for (; i + 4 <= in->n; i += 4) {
+		AKFV4 vx = V4_LOAD(&in->x[i]);
+		AKFV4 vy = V4_LOAD(&in->y[i]);
+		AKFV4 vz = V4_LOAD(&in->z[i]);
+		V4_STORE(&out->x[i], V4_SUB(V4_MUL(ay, vz), V4_MUL(az, vy)));
+		V4_STORE(&out->y[i], V4_SUB(V4_MUL(az, vx), V4_MUL(ax, vz)));
+		V4_STORE(&out->z[i], V4_SUB(V4_MUL(ax, vy), V4_MUL(ay, vx)));
+	}
+#endif
+	for (; i < in->n; i++) {
+		out->x[i] = a->u.y * in->z[i] - a->u.z * in->y[i];
+		out->y[i] = a->u.z * in->x[i] - a->u.x * in->z[i];
+		out->z[i] = a->u.x * in->y[i] - a->u.y * in->x[i];
+	}
+	out->n = in->n;
+}
@@ -0,0 +1,84 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2012 Asahi Kasei Microdevices Corporation, Japan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+#ifndef AKFS_INC_SOA_H
+#define AKFS_INC_SOA_H
+
+#include "AKFS_Device.h"
+
+/***** Constant definition ****************************************************/
+#define AKFS_SOA_SIZE	32
+
+/* The NEON and SSE kernels do the same single precision operations in the
+   same order as the scalar fallback and never fuse a multiply with an add,
+   so they match it bit for bit. A scalar build that lets the compiler
+   contract a*b+c into fma may differ by up to AKFS_SOA_ULP units in the last
+   place of each product sum. Define AKFS_SOA_NO_SIMD to force the scalar
+   code; double precision builds always use it. */
+#define AKFS_SOA_ULP	2
+
+/***** Type declaration *******************************************************/
+/*! Vectors stored axis by axis, so that a kernel reads contiguous floats. */
+typedef struct _AKFS_SOA{
+	AKFLOAT	x[AKFS_SOA_SIZE];
+	AKFLOAT	y[AKFS_SOA_SIZE];
+	AKFLOAT	z[AKFS_SOA_SIZE];
+	int16	n;
+} AKFS_SOA;
+
+/***** Prototype of function **************************************************/
+AKLIB_C_API_START
+int16 AKFS_SoaLoad(
+	const	AKFS_RING	*ring,
+	const	int16		n,
+			AKFS_SOA	*soa
+);
+
+void AKFS_SoaNorm(
+	const	AKFS_SOA	*in,
+	const	AKFVEC		*o,
+	const	AKFVEC		*k,
+			AKFS_SOA	*out
+);
+
+void AKFS_SoaMinMax(
+	const	AKFS_SOA	*soa,
+			AKFVEC		*min,
+			AKFVEC		*max
+);
+
+void AKFS_SoaDist2(
+	const	AKFS_SOA	*soa,
+	const	AKFVEC		*p,
+			AKFLOAT		d[]
+);
+
+void AKFS_SoaDot(
+	const	AKFS_SOA	*soa,
+	const	AKFVEC		*a,
+			AKFLOAT		d[]
+);
+
+void AKFS_SoaCross(
+	const	AKFVEC		*a,
+	const	AKFS_SOA	*in,
+			AKFS_SOA	*out
+);
+
+AKLIB_C_API_END
+
+#endif
@@ -0,0 +1,165 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2012 Asahi Kasei Microdevices Corporation, Japan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+#include "AKFS_Sphere.h"
+#include "AKFS_Math.h"
+
+/*
+ * Det3
+ */
+static double Det3(
+	const	double	m[3][3]
+){
+	return m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+		 - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+		 + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+}
+
+/******************************************************************************/
+/*! Estimate the hard iron offset with a recursive least squares sphere fit.
+  A point on the sphere satisfies |u - c|^2 = r^2, which is linear in c:
+  2 u.c + (r^2 - |c|^2) = |u|^2. Eliminating the constant term leaves the
+  3x3 system Cov(u) c = Cov(u, |u|^2) / 2, and both covariances come from
+  the running sums. Every sample decays the sums by the forgetting factor
+  and adds itself, so the cost per sample does not depend on the history.
+  @return #AKFS_SUCCESS when the offset is updated. Otherwise the return
+  value is #AKFS_ERROR and the offset is left as it is.
+  @param[in,out] sphv
+  @param[in] hdata A magnetic vector.
+  @param[out] ho The center of the fitted sphere.
+ */
+int16 AKFS_Sphere(
+			AKFS_SPHERE_VAR	*sphv,
+	const	AKFVEC			*hdata,
+			AKFVEC			*ho
+){
+	double	u[3];
+	double	m[3];
+	double	g[3];
+	double	cov[3][3];
+	double	a[3][3];
+	double	c[3];
+	double	q;
+	double	det;
+	double	tr;
+	double	r2;
+	int16	i, j;
+
+	/* The first sample is the origin of the statistics */
+	if (sphv->init == 0) {
+		sphv->ref = *hdata;
+		sphv->init = 1;
+	}
+
+	q = 0.0;
+	for (i = 0; i < 3; i++) {
+		u[i] = hdata->v[i] - sphv->ref.v[i];
+		q += u[i] * u[i];
+	}
+
+	/* update sufficient statistics */
+	sphv->w = sphv->lambda * sphv->w + 1.0;
+	sphv->sq = sphv->lambda * sphv->sq + q;
+	for (i = 0; i < 3; i++) {
+		sphv->su[i] = sphv->lambda * sphv->su[i] + u[i];
+		sphv->suq[i] = sphv->lambda * sphv->suq[i] + u[i] * q;
+		sphv->suu[i] = sphv->lambda * sphv->suu[i] + u[i] * u[i];
+		sphv->suu[i+3] = sphv->lambda * sphv->suu[i+3] + u[i] * u[(i+1)%3];
+	}
+
+	if (sphv->w < AKFS_SPH_WMIN) {
+		return AKFS_ERROR;
+	}
+
+	/* weighted means and covariances */
+	q = sphv->sq / sphv->w;
+	for (i = 0; i < 3; i++) {
+		m[i] = sphv->su[i] / sphv->w;
+	}
+	for (i = 0; i < 3; i++) {
+		g[i] = 0.5 * (sphv->suq[i] / sphv->w - m[i] * q);
+		cov[i][i] = sphv->suu[i] / sphv->w - m[i] * m[i];
+		j = (i+1)%3;
+		cov[i][j] = sphv->suu[i+3] / sphv->w - m[i] * m[j];
+		cov[j][i] = cov[i][j];
+	}
+
+	/* The samples must spread over all three axes */
+	det = Det3(cov);
+	tr = (cov[0][0] + cov[1][1] + cov[2][2]) / 3.0;
+	if ((tr <= 0.0) || (det < AKFS_SPH_COND * tr * tr * tr)) {
+		return AKFS_ERROR;
+	}
+
+	/* Cramer's rule */
+	for (j = 0; j < 3; j++) {
+		for (i = 0; i < 3; i++) {
+			a[i][0] = cov[i][0];
+			a[i][1] = cov[i][1];
+			a[i][2] = cov[i][2];
+			a[i][j] = g[i];
+		}
+		c[j] = Det3(a) / det;
+	}
+
+	/* r^2 = E|u - c|^2 */
+	r2 = q;
+	for (i = 0; i < 3; i++) {
+		r2 += c[i] * c[i] - 2.0 * m[i] * c[i];
+	}
+	if ((r2 < AKFS_SPH_RMIN * AKFS_SPH_RMIN) ||
+		(r2 > AKFS_SPH_RMAX * AKFS_SPH_RMAX)) {
+		return AKFS_ERROR;
+	}
+
+	for (i = 0; i < 3; i++) {
+		ho->v[i] = (AKFLOAT)(c[i] + sphv->ref.v[i]);
+	}
+	sphv->hr = (AKFLOAT)sqrt(r2);
+
+	return AKFS_SUCCESS;
+}
+
+/******************************************************************************/
+/*! Clear the statistics of #AKFS_Sphere.
+  @param[out] sphv
+  @param[in] lambda The forgetting factor in (0, 1]. Out of range values
+  select #AKFS_SPH_LAMBDA.
+ */
+void AKFS_InitSphere(
+			AKFS_SPHERE_VAR	*sphv,
+	const	AKFLOAT			lambda
+){
+	int16 i;
+
+	sphv->w = 0.0;
+	sphv->sq = 0.0;
+	for (i = 0; i < 3; i++) {
+		sphv->su[i] = 0.0;
+		sphv->suq[i] = 0.0;
+		sphv->suu[i] = 0.0;
+		sphv->suu[i+3] = 0.0;
+	}
+	sphv->hr = 0.0;
+	sphv->init = 0;
+
+	if ((lambda <= 0.0) || (lambda > 1.0)) {
+		sphv->lambda = AKFS_SPH_LAMBDA;
+	} else {
+		sphv->lambda = lambda;
+	}
+}
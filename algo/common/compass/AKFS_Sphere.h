@@ -0,0 +1,66 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2012 Asahi Kasei Microdevices Corporation, Japan
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ ******************************************************************************/
+#ifndef AKFS_INC_SPHERE_H
+#define AKFS_INC_SPHERE_H
+
+#include "AKFS_Device.h"
+
+/***** Constant definition ****************************************************/
+/* Default forgetting factor, about 200 samples of memory */
+#define AKFS_SPH_LAMBDA	0.995
+/* Weight of the statistics needed before a fit is trusted */
+#define AKFS_SPH_WMIN	20.0
+/* Minimum det(C) / (tr(C)/3)^3 of the sample covariance. Samples along a
+   plane or a line leave one axis of the center undetermined. */
+#define AKFS_SPH_COND	0.05
+/* Accepted radius of the fitted sphere, uT */
+#define AKFS_SPH_RMIN	10.0
+#define AKFS_SPH_RMAX	100.0
+
+/***** Type declaration *******************************************************/
+/*! Exponentially weighted sufficient statistics of the samples u = h - ref.
+   The sums are kept in double, the second and third moments of raw uT
+   values lose too much in float over a long memory. */
+typedef struct _AKFS_SPHERE_VAR{
+	double		w;		/* sum of weights */
+	double		su[3];	/* sum of u */
+	double		suu[6];	/* sum of u u^T: xx, yy, zz, xy, yz, zx */
+	double		suq[3];	/* sum of u |u|^2 */
+	double		sq;		/* sum of |u|^2 */
+	AKFVEC		ref;
+	AKFLOAT		lambda;
+	AKFLOAT		hr;		/* radius of the last accepted fit */
+	int16		init;
+} AKFS_SPHERE_VAR;
+
+/***** Prototype of function **************************************************/
+AKLIB_C_API_START
+int16 AKFS_Sphere(
+			AKFS_SPHERE_VAR	*sphv,
+	const	AKFVEC			*hdata,
+			AKFVEC			*ho
+);
+
+void AKFS_InitSphere(
+			AKFS_SPHERE_VAR	*sphv,
+	const	AKFLOAT			lambda
+);
+
+AKLIB_C_API_END
+
+#endif
@@ -21,34 +21,32 @@
 /******************************************************************************/
 /*! Normalize vector.
   @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
-  @param[in] ndata Size of raw vector buffer
-  @param[in] vdata Raw vector buffer
+  @param[in] vdata Raw vector ring
   @param[in] nbuf Size of data to be buffered
   @param[in] o Offset
   @param[in] s Sensitivity
   @param[in] tgt Target sensitivity
-  @param[in] nvec Size of normalized vector buffer
-  @param[out] vvec Normalized vector buffer
+  @param[out] vvec Normalized vector ring
  */
 int16 AKFS_VbNorm(
-	const	int16	ndata,
-	const	AKFVEC	vdata[],
-	const	int16	nbuf,
-	const	AKFVEC	*o,
-	const	AKFVEC	*s,
-	const	AKFLOAT	tgt,
-	const	int16	nvec,
-			AKFVEC	vvec[]
+	const	AKFS_RING	*vdata,
+	const	int16		nbuf,
+	const	AKFVEC		*o,
+	const	AKFVEC		*s,
+	const	AKFLOAT		tgt,
+			AKFS_RING	*vvec
 )
 {
 	int i;
+	AKFVEC v;
+	const AKFVEC *d;
 
 	/* size check */
-	if ((ndata <= 0) || (nvec <= 0) || (nbuf <= 0)) {
+	if ((vdata->size <= 0) || (vvec->size <= 0) || (nbuf <= 0)) {
 		return AKFS_ERROR;
 	}
 	/* dependency check */
-	if ((nbuf < 1) || (ndata < nbuf) || (nvec < nbuf)) {
+	if ((nbuf < 1) || (vdata->size < nbuf) || (vvec->size < nbuf)) {
 		return AKFS_ERROR;
 	}
 	/* sensitivity check */
@@ -59,14 +57,13 @@ int16 AKFS_VbNorm(
 		return AKFS_ERROR;
 	}
 
-	/* calculate and store data to buffer */
-	if (AKFS_BufShift(nvec, nbuf, vvec) != AKFS_SUCCESS) {
-		return AKFS_ERROR;
-	}
-	for (i = 0; i < nbuf; i++) {
-		vvec[i].u.x = ((vdata[i].u.x - o->u.x) / (s->u.x) * (AKFLOAT)tgt);
-		vvec[i].u.y = ((vdata[i].u.y - o->u.y) / (s->u.y) * (AKFLOAT)tgt);
-		vvec[i].u.z = ((vdata[i].u.z - o->u.z) / (s->u.z) * (AKFLOAT)tgt);
+	/* calculate and store data to buffer, the newest last */
+	for (i = nbuf - 1; i >= 0; i--) {
+		d = AKFS_RingAt(vdata, i);
+		v.u.x = ((d->u.x - o->u.x) / (s->u.x) * (AKFLOAT)tgt);
+		v.u.y = ((d->u.y - o->u.y) / (s->u.y) * (AKFLOAT)tgt);
+		v.u.z = ((d->u.z - o->u.z) / (s->u.z) * (AKFLOAT)tgt);
+		AKFS_RingPush(&v, vvec);
 	}
 
 	return AKFS_SUCCESS;
@@ -75,22 +72,21 @@ int16 AKFS_VbNorm(
 /******************************************************************************/
 /*! Calculate an averaged vector form a given buffer.
   @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
-  @param[in] nvec Size of normalized vector buffer
-  @param[in] vvec Normalized vector buffer
+  @param[in] vvec Normalized vector ring
   @param[in] nave Number of average
   @param[out] vave Averaged vector
  */
 int16 AKFS_VbAve(
-	const	int16	nvec,
-	const	AKFVEC	vvec[],
-	const	int16	nave,
-			AKFVEC	*vave
+	const	AKFS_RING	*vvec,
+	const	int16		nave,
+			AKFVEC		*vave
 )
 {
 	int i;
+	const AKFVEC *v;
 
 	/* arguments check */
-	if ((nave <= 0) || (nvec <= 0) || (nvec < nave)) {
+	if ((nave <= 0) || (vvec->size <= 0) || (vvec->size < nave)) {
 		return AKFS_ERROR;
 	}
 
@@ -99,14 +95,15 @@ int16 AKFS_VbAve(
 	vave->u.y = 0;
 	vave->u.z = 0;
 	for (i = 0; i < nave; i++) {
-		if ((vvec[i].u.x == AKFS_INIT_VALUE_F) ||
-			(vvec[i].u.y == AKFS_INIT_VALUE_F) ||
-			(vvec[i].u.z == AKFS_INIT_VALUE_F)) {
+		v = AKFS_RingAt(vvec, i);
+		if ((v->u.x == AKFS_INIT_VALUE_F) ||
+			(v->u.y == AKFS_INIT_VALUE_F) ||
+			(v->u.z == AKFS_INIT_VALUE_F)) {
 				break;
 		}
-		vave->u.x += vvec[i].u.x;
-		vave->u.y += vvec[i].u.y;
-		vave->u.z += vvec[i].u.z;
+		vave->u.x += v->u.x;
+		vave->u.y += v->u.y;
+		vave->u.z += v->u.z;
 	}
 	if (i == 0) {
 		vave->u.x = 0;
@@ -120,4 +117,149 @@ int16 AKFS_VbAve(
 	return AKFS_SUCCESS;
 }
 
+/******************************************************************************/
+/*! Precompute the offset and reciprocal sensitivity used by #AKFS_VbNormInc.
+  Call it again whenever the offset or the sensitivity changes.
+  @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
+  @param[in] o Offset
+  @param[in] s Sensitivity
+  @param[in] tgt Target sensitivity
+  @param[out] norm
+ */
+int16 AKFS_SetNorm(
+	const	AKFVEC		*o,
+	const	AKFVEC		*s,
+	const	AKFLOAT		tgt,
+			AKFS_NORM	*norm
+)
+{
+	/* sensitivity check */
+	if ((s->u.x <= AKFS_EPSILON) ||
+		(s->u.y <= AKFS_EPSILON) ||
+		(s->u.z <= AKFS_EPSILON) ||
+		(tgt <= 0)) {
+		return AKFS_ERROR;
+	}
+
+	norm->o = *o;
+	norm->k.u.x = tgt / s->u.x;
+	norm->k.u.y = tgt / s->u.y;
+	norm->k.u.z = tgt / s->u.z;
+
+	return AKFS_SUCCESS;
+}
+
+/******************************************************************************/
+/*! Clear a running average. The ring it follows must be initialized too.
+  @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
+  @param[in] nave Number of average
+  @param[out] ave
+ */
+int16 AKFS_InitAve(
+	const	int16		nave,
+			AKFS_AVE	*ave
+)
+{
+	if (nave <= 0) {
+		return AKFS_ERROR;
+	}
+
+	ave->sum.u.x = 0;
+	ave->sum.u.y = 0;
+	ave->sum.u.z = 0;
+	ave->rcount = 0;
+	ave->nave = nave;
+	ave->count = 0;
+	ave->age = 0;
+
+	return AKFS_SUCCESS;
+}
+
+/******************************************************************************/
+/*! Normalize the newest vector into a ring and update its running average.
+  The vector leaving the averaging window is subtracted from the sum. The sum
+  is recomputed from the ring every #AKFS_AVE_RESYNC pushes so that rounding
+  errors do not pile up.
+  @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
+  @param[in] norm Offset and reciprocal sensitivity
+  @param[in] vdata The newest raw vector
+  @param[in,out] vvec Normalized vector ring
+  @param[in,out] ave Running average of vvec
+ */
+int16 AKFS_VbNormInc(
+	const	AKFS_NORM	*norm,
+	const	AKFVEC		*vdata,
+			AKFS_RING	*vvec,
+			AKFS_AVE	*ave
+)
+{
+	int i;
+	AKFVEC v;
+	const AKFVEC *d;
+
+	/* dependency check */
+	if ((ave->nave <= 0) || (vvec->size < ave->nave)) {
+		return AKFS_ERROR;
+	}
+
+	v.u.x = (vdata->u.x - norm->o.u.x) * norm->k.u.x;
+	v.u.y = (vdata->u.y - norm->o.u.y) * norm->k.u.y;
+	v.u.z = (vdata->u.z - norm->o.u.z) * norm->k.u.z;
+
+	/* The oldest vector of a full window expires with this push */
+	if (ave->count == ave->nave) {
+		d = AKFS_RingAt(vvec, ave->nave - 1);
+		ave->sum.u.x -= d->u.x;
+		ave->sum.u.y -= d->u.y;
+		ave->sum.u.z -= d->u.z;
+	} else {
+		ave->count++;
+		ave->rcount = (AKFLOAT)1 / ave->count;
+	}
+	AKFS_RingPush(&v, vvec);
+
+	if (++ave->age < AKFS_AVE_RESYNC) {
+		ave->sum.u.x += v.u.x;
+		ave->sum.u.y += v.u.y;
+		ave->sum.u.z += v.u.z;
+		return AKFS_SUCCESS;
+	}
+
+	/* resync */
+	ave->age = 0;
+	ave->sum.u.x = 0;
+	ave->sum.u.y = 0;
+	ave->sum.u.z = 0;
+	for (i = 0; i < ave->count; i++) {
+		d = AKFS_RingAt(vvec, i);
+		ave->sum.u.x += d->u.x;
+		ave->sum.u.y += d->u.y;
+		ave->sum.u.z += d->u.z;
+	}
+
+	return AKFS_SUCCESS;
+}
+
+/******************************************************************************/
+/*! Read the running average maintained by #AKFS_VbNormInc. It matches
+  #AKFS_VbAve over the same ring, up to rounding.
+  @return #AKFS_SUCCESS on success. Otherwise the return value is #AKFS_ERROR.
+  @param[in] ave
+  @param[out] vave Averaged vector
+ */
+int16 AKFS_VbAveInc(
+	const	AKFS_AVE	*ave,
+			AKFVEC		*vave
+)
+{
+	if (ave->nave <= 0) {
+		return AKFS_ERROR;
+	}
+
+	vave->u.x = ave->sum.u.x * ave->rcount;
+	vave->u.y = ave->sum.u.y * ave->rcount;
+	vave->u.z = ave->sum.u.z * ave->rcount;
+
+	return AKFS_SUCCESS;
+}
 
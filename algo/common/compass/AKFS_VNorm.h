@@ -20,24 +20,65 @@
 
 #include "AKFS_Device.h"
 
+/***** Constant definition ****************************************************/
+/* Pushes between two recomputations of a running sum from its ring */
+#define AKFS_AVE_RESYNC	256
+
+/***** Type declaration *******************************************************/
+/*! Offset and reciprocal sensitivity of #AKFS_VbNormInc. */
+typedef struct _AKFS_NORM{
+	AKFVEC	o;
+	AKFVEC	k;		/* tgt / s */
+} AKFS_NORM;
+
+/*! Running sum of the newest nave vectors of a ring. */
+typedef struct _AKFS_AVE{
+	AKFVEC	sum;
+	AKFLOAT	rcount;	/* 1 / count */
+	int16	nave;
+	int16	count;	/* valid vectors in the window */
+	int16	age;	/* pushes since the last resync */
+} AKFS_AVE;
+
 /***** Prototype of function **************************************************/
 AKLIB_C_API_START
 int16 AKFS_VbNorm(
-	const	int16	ndata,
-	const	AKFVEC	vdata[],
-	const	int16	nbuf,
-	const	AKFVEC	*o,
-	const	AKFVEC	*s,
-	const	AKFLOAT	tgt,
-	const	int16	nvec,
-			AKFVEC	vvec[]
+	const	AKFS_RING	*vdata,
+	const	int16		nbuf,
+	const	AKFVEC		*o,
+	const	AKFVEC		*s,
+	const	AKFLOAT		tgt,
+			AKFS_RING	*vvec
 );
 
 int16 AKFS_VbAve(
-	const	int16	nvec,
-	const	AKFVEC	vvec[],
-	const	int16	nave,
-			AKFVEC	*vave
+	const	AKFS_RING	*vvec,
+	const	int16		nave,
+			AKFVEC		*vave
+);
+
+int16 AKFS_SetNorm(
+	const	AKFVEC		*o,
+	const	AKFVEC		*s,
+	const	AKFLOAT		tgt,
+			AKFS_NORM	*norm
+);
+
+int16 AKFS_InitAve(
+	const	int16		nave,
+			AKFS_AVE	*ave
+);
+
+int16 AKFS_VbNormInc(
+	const	AKFS_NORM	*norm,
+	const	AKFVEC		*vdata,
+			AKFS_RING	*vvec,
+			AKFS_AVE	*ave
+);
+
+int16 AKFS_VbAveInc(
+	const	AKFS_AVE	*ave,
+			AKFVEC		*vave
 );
 
 AKLIB_C_API_END
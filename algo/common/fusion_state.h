@@ -0,0 +1,79 @@
+/*--------------------------------------------------------------------------
+Copyright (c) 2014, The Linux Foundation. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above
+      copyright notice, this list of conditions and the following
+      disclaimer in the documentation and/or other materials provided
+      with the distribution.
+    * Neither the name of The Linux Foundation nor the names of its
+      contributors may be used to endorse or promote products derived
+      from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+--------------------------------------------------------------------------*/
+
+#ifndef SENSOR_FUSION_STATE_H
+#define SENSOR_FUSION_STATE_H
+
+#include <stdint.h>
+#include <hardware/sensors.h>
+
+struct sensor_vec {
+	union {
+		struct {
+			float data[4];
+		};
+		struct {
+			float x;
+			float y;
+			float z;
+		};
+	};
+};
+
+/* Accelerometer and magnetometer fusion shared by the orientation outputs.
+ * Every output feeds the same input events, the state is only updated for
+ * the first one and the others project the cached results.
+ */
+struct fusion_state {
+	struct sensor_vec acc;
+	struct sensor_vec mag;
+	/* The input sample the results below were computed for */
+	int type;
+	int64_t timestamp;
+	/* The accelerometer norm is usable */
+	int valid;
+	/* The results below come from fast_math rather than libm */
+	int fast;
+	/* Radians */
+	float pitch;
+	float roll;
+	float azimuth;
+	/* Rotation vector, computed on first use for each sample */
+	int quat_valid;
+	float quat[4];
+};
+
+void fusion_reset(struct fusion_state *state);
+/* Return 0 if the state holds valid angles for the sample. fast selects
+ * fast_math, a sample already applied with the other math is recomputed.
+ */
+int fusion_update(struct fusion_state *state, const sensors_event_t *raw, int fast);
+const float* fusion_get_quat(struct fusion_state *state);
+
+#endif
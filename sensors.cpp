@@ -41,6 +41,7 @@
 #include "PressureSensor.h"
 
 #include "NativeSensorManager.h"
+#include "FusionPipeline.h"
 #include "sensors_extension.h"
 /*****************************************************************************/
 
@@ -87,17 +88,44 @@ struct sensors_poll_context_t {
 	int flush(int handle);
 
 private:
-	static const size_t wake = MAX_SENSORS;
+	int updatePollFds();
 	static const char WAKE_MESSAGE = 'W';
-	struct pollfd mPollFds[MAX_SENSORS+1];
+	struct pollfd *mPollFds;
+	int mWakeReadFd;
 	int mWritePipeFd;
-	SensorBase* mSensors[MAX_SENSORS];
 	mutable Mutex mLock;
 };
 
 /*****************************************************************************/
 
 sensors_poll_context_t::sensors_poll_context_t()
+{
+	NativeSensorManager& sm(NativeSensorManager::getInstance());
+	int wakeFds[2];
+	int result = pipe(wakeFds);
+	ALOGE_IF(result<0, "error creating wake pipe (%s)", strerror(errno));
+	fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
+	mWakeReadFd = wakeFds[0];
+	mWritePipeFd = wakeFds[1];
+
+	/* The sensors plus the wake pipe, the hotplug fd and the fusion notify fd */
+	mPollFds = new struct pollfd[sm.getCapacity() + 3];
+
+	ALOGI("The avaliable sensor handle number is %d", updatePollFds());
+}
+
+sensors_poll_context_t::~sensors_poll_context_t() {
+	close(mWakeReadFd);
+	close(mWritePipeFd);
+	delete [] mPollFds;
+}
+
+/* Rebuild the poll set from the dynamic sensor list. The wake pipe, the
+ * hotplug fd and the fusion notify fd follow the sensors. Return the sensor
+ * number.
+ */
+int sensors_poll_context_t::updatePollFds()
 {
 	int number;
 	int i;
@@ -116,25 +144,19 @@ sensors_poll_context_t::sensors_poll_context_t()
 		mPollFds[i].revents = 0;
 	}
 
-	ALOGI("The avaliable sensor handle number is %d",i);
-	int wakeFds[2];
-	int result = pipe(wakeFds);
-	ALOGE_IF(result<0, "error creating wake pipe (%s)", strerror(errno));
-	fcntl(wakeFds[0], F_SETFL, O_NONBLOCK);
-	fcntl(wakeFds[1], F_SETFL, O_NONBLOCK);
-	mWritePipeFd = wakeFds[1];
-
-	mPollFds[number].fd = wakeFds[0];
+	mPollFds[number].fd = mWakeReadFd;
 	mPollFds[number].events = POLLIN;
 	mPollFds[number].revents = 0;
-}
 
-sensors_poll_context_t::~sensors_poll_context_t() {
-	NativeSensorManager& sm(NativeSensorManager::getInstance());
-	int number = sm.getSensorCount();
+	mPollFds[number + 1].fd = sm.getHotplugFd();
+	mPollFds[number + 1].events = POLLIN;
+	mPollFds[number + 1].revents = 0;
 
-	close(mPollFds[number].fd);
-	close(mWritePipeFd);
+	mPollFds[number + 2].fd = FusionPipeline::getInstance().getNotifyFd();
+	mPollFds[number + 2].events = POLLIN;
+	mPollFds[number + 2].revents = 0;
+
+	return number;
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled) {
@@ -166,6 +188,8 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 {
 	int nbEvents = 0;
 	int n = 0;
+	int timeout;
+	bool expired = false;
 	NativeSensorManager& sm(NativeSensorManager::getInstance());
 	const sensor_t *slist;
 	int number = sm.getSensorList(&slist);
@@ -173,8 +197,9 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 	do {
 		// see if we have some leftover from the last poll()
 		for (int i = 0 ; count && i < number ; i++) {
+			/* activate may free a virtual sensor driver */
+			Mutex::Autolock _l(mLock);
 			if ((mPollFds[i].revents & POLLIN) || (sm.hasPendingEvents(slist[i].handle))) {
-				Mutex::Autolock _l(mLock);
 				int nb = sm.readEvents(slist[i].handle, data, count);
 				if (nb < 0) {
 					ALOGE("readEvents failed.(%d)", errno);
@@ -194,8 +219,15 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 			// we still have some room, so try to see if we can get
 			// some events immediately or just wait if we don't have
 			// anything to return
+			/* Wake up for the batches the HAL holds as well */
+			if (nbEvents) {
+				timeout = 0;
+			} else {
+				Mutex::Autolock _l(mLock);
+				timeout = sm.getBatchTimeout();
+			}
 			do {
-				n = poll(mPollFds, number + 1, nbEvents ? 0 : -1);
+				n = poll(mPollFds, number + 3, timeout);
 			} while (n < 0 && errno == EINTR);
 			if (n<0) {
 				ALOGE("poll() failed (%s)", strerror(errno));
@@ -208,9 +240,22 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 				ALOGE_IF(msg != WAKE_MESSAGE, "unknown message on wake queue (0x%02x)", int(msg));
 				mPollFds[number].revents = 0;
 			}
+			if (mPollFds[number + 1].revents & POLLIN) {
+				Mutex::Autolock _l(mLock);
+				if (sm.handleHotplug() > 0)
+					number = updatePollFds();
+				mPollFds[number + 1].revents = 0;
+			}
+			/* virtual sensor results are picked up by hasPendingEvents */
+			if (mPollFds[number + 2].revents & POLLIN) {
+				FusionPipeline::getInstance().clearNotify();
+				mPollFds[number + 2].revents = 0;
+			}
+			/* woken up by a batch deadline, go release it */
+			expired = (n == 0) && (timeout >= 0) && !nbEvents;
 		}
 		// if we have events and space, go read them
-	} while (n && count);
+	} while ((n || expired) && count);
 
 	return nbEvents;
 }